@@ -0,0 +1,151 @@
+﻿#pragma once
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Наибольшая длина десятичной записи long long со знаком
+const size_t MaxIntLength = 20;
+
+// Десятичная запись числа в text (не менее MaxIntLength символов); возвращает длину.
+// std::to_chars не зависит от локали и не выделяет память
+inline size_t formatInt(long long value, char* text)
+{
+    return static_cast<size_t>(std::to_chars(text, text + MaxIntLength, value).ptr - text);
+}
+
+// Открытие файла; в MSVC через fopen_s (fopen там считается небезопасным и при SDL-проверках не компилируется)
+inline std::FILE* openFile(const std::string& path, const char* mode)
+{
+#if defined(_MSC_VER)
+    std::FILE* file = nullptr;
+    return fopen_s(&file, path.c_str(), mode) == 0 ? file : nullptr;
+#else
+    return std::fopen(path.c_str(), mode);
+#endif
+}
+
+// Буферизованный вывод в FILE*: данные копируются в буфер и сбрасываются крупными блоками,
+// числа переводятся в текст без потоков и локалей. Через него идёт весь вывод множеств
+// (SetFormatter.h): вывод миллионов элементов через cout был бы узким местом.
+class BufferedWriter
+{
+private:
+    std::FILE* file;
+    std::vector<char> buffer;
+    size_t used;
+
+public:
+    BufferedWriter(std::FILE* output, size_t capacity = 1 << 16)
+        : file(output), buffer(capacity), used(0)
+    {
+    }
+
+    ~BufferedWriter()
+    {
+        flush();
+    }
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    void flush()
+    {
+        if (used > 0)
+        {
+            std::fwrite(buffer.data(), 1, used, file);
+            used = 0;
+        }
+        std::fflush(file);
+    }
+
+    void write(const char* data, size_t length)
+    {
+        if (used + length > buffer.size())
+        {
+            std::fwrite(buffer.data(), 1, used, file);
+            used = 0;
+            // Длинные куски пишутся напрямую, минуя буфер
+            if (length > buffer.size())
+            {
+                std::fwrite(data, 1, length, file);
+                return;
+            }
+        }
+        std::memcpy(buffer.data() + used, data, length);
+        used += length;
+    }
+
+    void write(const std::string& text)
+    {
+        write(text.data(), text.size());
+    }
+
+    void write(const char* text)
+    {
+        write(text, std::strlen(text));
+    }
+
+    void write(char c)
+    {
+        if (used == buffer.size())
+        {
+            std::fwrite(buffer.data(), 1, used, file);
+            used = 0;
+        }
+        buffer[used++] = c;
+    }
+
+    // Число форматируется прямо в буфер
+    void writeInt(long long value)
+    {
+        if (used + MaxIntLength > buffer.size())
+        {
+            std::fwrite(buffer.data(), 1, used, file);
+            used = 0;
+        }
+        used += formatInt(value, buffer.data() + used);
+    }
+};
+
+// Вывод в строку с тем же интерфейсом: тексты, подготовленные в разных потоках,
+// затем выводятся через BufferedWriter в нужном порядке
+class StringWriter
+{
+private:
+    std::string text;
+
+public:
+    void write(const char* data, size_t length)
+    {
+        text.append(data, length);
+    }
+
+    void write(const std::string& data)
+    {
+        text += data;
+    }
+
+    void write(const char* data)
+    {
+        text += data;
+    }
+
+    void write(char c)
+    {
+        text += c;
+    }
+
+    void writeInt(long long value)
+    {
+        char digits[MaxIntLength];
+        text.append(digits, formatInt(value, digits));
+    }
+
+    const std::string& str() const
+    {
+        return text;
+    }
+};
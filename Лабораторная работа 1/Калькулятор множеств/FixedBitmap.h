@@ -0,0 +1,199 @@
+﻿#pragma once
+
+#include <cstdint>
+#include "BitOps.h"
+
+// Битовая карта фиксированного размера: бит i установлен, если элемент i входит в множество.
+// Все слова хранятся внутри объекта, поэтому операции не выделяют память в куче,
+// а каждая операция над множествами сводится к нескольким словным AND/OR/XOR/ANDN.
+template <int Bits>
+class FixedBitmap
+{
+public:
+    static const int BitCount = Bits;
+    static const int WordCount = (Bits + 63) / 64;
+
+private:
+    uint64_t words[WordCount];
+
+    // Маска допустимых битов последнего слова (хвост за пределами Bits всегда нулевой)
+    static uint64_t tailMask()
+    {
+        return lowMask(Bits - (WordCount - 1) * 64);
+    }
+
+public:
+    FixedBitmap()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        for (int w = 0; w < WordCount; w++) words[w] = 0;
+    }
+
+    // Заполнение всеми элементами (универсум)
+    void fill()
+    {
+        for (int w = 0; w < WordCount; w++) words[w] = ~0ULL;
+        words[WordCount - 1] &= tailMask();
+    }
+
+    void set(int bit)
+    {
+        words[bit >> 6] |= 1ULL << (bit & 63);
+    }
+
+    void reset(int bit)
+    {
+        words[bit >> 6] &= ~(1ULL << (bit & 63));
+    }
+
+    // Установка всех битов отрезка [first, last]
+    void setRange(int first, int last)
+    {
+        int firstWord = first >> 6;
+        int lastWord = last >> 6;
+        uint64_t firstMask = ~0ULL << (first & 63);
+        uint64_t lastMask = lowMask((last & 63) + 1);
+        if (firstWord == lastWord)
+        {
+            words[firstWord] |= firstMask & lastMask;
+            return;
+        }
+        words[firstWord] |= firstMask;
+        for (int w = firstWord + 1; w < lastWord; w++) words[w] = ~0ULL;
+        words[lastWord] |= lastMask;
+    }
+
+    bool test(int bit) const
+    {
+        return (words[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    uint64_t word(int index) const
+    {
+        return words[index];
+    }
+
+    uint64_t& word(int index)
+    {
+        return words[index];
+    }
+
+    // Мощность множества через popcount по словам
+    int count() const
+    {
+        int total = 0;
+        for (int w = 0; w < WordCount; w++) total += bitCount(words[w]);
+        return total;
+    }
+
+    // Количество установленных битов с номерами из [first, last]
+    int countRange(int first, int last) const
+    {
+        int firstWord = first >> 6;
+        int lastWord = last >> 6;
+        uint64_t firstMask = ~0ULL << (first & 63);
+        uint64_t lastMask = lowMask((last & 63) + 1);
+        if (firstWord == lastWord) return bitCount(words[firstWord] & firstMask & lastMask);
+        int total = bitCount(words[firstWord] & firstMask) + bitCount(words[lastWord] & lastMask);
+        for (int w = firstWord + 1; w < lastWord; w++) total += bitCount(words[w]);
+        return total;
+    }
+
+    bool empty() const
+    {
+        uint64_t any = 0;
+        for (int w = 0; w < WordCount; w++) any |= words[w];
+        return any == 0;
+    }
+
+    // Обход установленных битов по возрастанию
+    template <typename Func>
+    void forEach(Func func) const
+    {
+        for (int w = 0; w < WordCount; w++)
+        {
+            uint64_t bits = words[w];
+            while (bits != 0)
+            {
+                func(w * 64 + lowestBit(bits));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    FixedBitmap& operator|=(const FixedBitmap& other)
+    {
+        for (int w = 0; w < WordCount; w++) words[w] |= other.words[w];
+        return *this;
+    }
+
+    FixedBitmap& operator&=(const FixedBitmap& other)
+    {
+        for (int w = 0; w < WordCount; w++) words[w] &= other.words[w];
+        return *this;
+    }
+
+    FixedBitmap& operator^=(const FixedBitmap& other)
+    {
+        for (int w = 0; w < WordCount; w++) words[w] ^= other.words[w];
+        return *this;
+    }
+
+    // Разность: this & ~other
+    FixedBitmap& andNot(const FixedBitmap& other)
+    {
+        for (int w = 0; w < WordCount; w++) words[w] &= ~other.words[w];
+        return *this;
+    }
+
+    // Дополнение до всех Bits элементов
+    FixedBitmap complement() const
+    {
+        FixedBitmap result;
+        for (int w = 0; w < WordCount; w++) result.words[w] = ~words[w];
+        result.words[WordCount - 1] &= tailMask();
+        return result;
+    }
+
+    bool operator==(const FixedBitmap& other) const
+    {
+        for (int w = 0; w < WordCount; w++)
+        {
+            if (words[w] != other.words[w]) return false;
+        }
+        return true;
+    }
+
+    bool operator!=(const FixedBitmap& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+template <int Bits>
+FixedBitmap<Bits> operator|(FixedBitmap<Bits> left, const FixedBitmap<Bits>& right)
+{
+    return left |= right;
+}
+
+template <int Bits>
+FixedBitmap<Bits> operator&(FixedBitmap<Bits> left, const FixedBitmap<Bits>& right)
+{
+    return left &= right;
+}
+
+template <int Bits>
+FixedBitmap<Bits> operator^(FixedBitmap<Bits> left, const FixedBitmap<Bits>& right)
+{
+    return left ^= right;
+}
+
+template <int Bits>
+FixedBitmap<Bits> andNot(FixedBitmap<Bits> left, const FixedBitmap<Bits>& right)
+{
+    return left.andNot(right);
+}
@@ -0,0 +1,393 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+#include "RoaringSet.h"
+#include "SetFormula.h"
+#include "FormulaSimplifier.h"
+#include "FusedEvaluation.h"
+#include "SetRegistry.h"
+#include "ParallelSetOps.h"
+#include "SetHandle.h"
+
+// Кэш результатов вычисления формул и их подвыражений.
+// Ключ - каноническая запись подвыражения: множества обозначаются идентификаторами реестра,
+// операнды коммутативных цепочек сортируются, так что A*B и B*A дают один ключ.
+// Каждая запись хранит версии множеств, от которых зависит; запись с устаревшей версией
+// хотя бы одного множества считается недействительной и удаляется при обращении.
+// Поэтому изменение одного множества затрагивает только результаты, в которых оно участвует.
+// Кэш можно использовать из нескольких потоков, пока множества реестра не меняются:
+// поиск и запись идут под блокировкой, а сами вычисления - вне её.
+// evaluateHandle и count не строят дополнения: они поднимаются к корню формулы и остаются флагом SetHandle.
+class FormulaCache
+{
+public:
+    typedef std::shared_ptr<const RoaringSet> SetPtr;
+    static const size_t DefaultBudget = 256u << 20;
+
+private:
+    struct Dependency
+    {
+        int id;
+        uint64_t version;
+    };
+
+    struct Entry
+    {
+        SetPtr result;
+        std::vector<Dependency> dependencies;
+        uint64_t lastUse;
+        size_t bytes;
+    };
+
+    std::unordered_map<std::string, Entry> entries;
+    size_t budgetBytes;
+    size_t usedBytes;
+    uint64_t useClock;
+    size_t hitCount;
+    size_t missCount;
+    ThreadPool* pool;       // Если задан, большие вычисления делятся по блокам между потоками
+    mutable std::mutex lock;
+
+    // Контекст одного вычисления: формула, реестр и ключи всех узлов
+    struct Context
+    {
+        const Formula& formula;
+        const SetRegistry& registry;
+        int universeMin;
+        int universeMax;
+        std::vector<std::string> keys;
+    };
+
+    static char symbol(FormulaOp op)
+    {
+        switch (op)
+        {
+        case FormulaOp::Union: return '+';
+        case FormulaOp::Intersection: return '*';
+        case FormulaOp::Difference: return '-';
+        default: return '^';
+        }
+    }
+
+    static void flatten(const std::vector<FormulaNode>& nodes, int node, FormulaOp op, std::vector<int>& operands)
+    {
+        if (nodes[node].op == op)
+        {
+            flatten(nodes, nodes[node].left, op, operands);
+            flatten(nodes, nodes[node].right, op, operands);
+        }
+        else
+        {
+            operands.push_back(node);
+        }
+    }
+
+    static void buildKeys(const std::vector<FormulaNode>& nodes, int node, std::vector<std::string>& keys)
+    {
+        if (!keys[node].empty()) return;
+        const FormulaNode& n = nodes[node];
+        if (n.left >= 0) buildKeys(nodes, n.left, keys);
+        if (n.right >= 0) buildKeys(nodes, n.right, keys);
+
+        switch (n.op)
+        {
+        case FormulaOp::Set:
+            keys[node] = "#" + std::to_string(n.operand);
+            break;
+        case FormulaOp::Empty:
+            keys[node] = "{}";
+            break;
+        case FormulaOp::Universe:
+            keys[node] = "U";
+            break;
+        case FormulaOp::Complement:
+            keys[node] = "!" + keys[n.left];
+            break;
+        case FormulaOp::Difference:
+            keys[node] = "(" + keys[n.left] + "-" + keys[n.right] + ")";
+            break;
+        default:
+        {
+            // Коммутативная и ассоциативная цепочка: ключи операндов в лексикографическом порядке
+            std::vector<int> operands;
+            flatten(nodes, node, n.op, operands);
+            std::vector<std::string> parts;
+            for (int operand : operands) parts.push_back(keys[operand]);
+            std::sort(parts.begin(), parts.end());
+            std::string key = "(";
+            for (size_t i = 0; i < parts.size(); i++)
+            {
+                if (i > 0) key += symbol(n.op);
+                key += parts[i];
+            }
+            keys[node] = key + ")";
+            break;
+        }
+        }
+    }
+
+    static void collectDependencies(const std::vector<FormulaNode>& nodes, int node, std::vector<int>& ids)
+    {
+        const FormulaNode& n = nodes[node];
+        if (n.op == FormulaOp::Set) ids.push_back(n.operand);
+        if (n.left >= 0) collectDependencies(nodes, n.left, ids);
+        if (n.right >= 0) collectDependencies(nodes, n.right, ids);
+    }
+
+    bool valid(const Entry& entry, const SetRegistry& registry) const
+    {
+        for (const Dependency& dependency : entry.dependencies)
+        {
+            if (!registry.exists(dependency.id) || registry.version(dependency.id) != dependency.version) return false;
+        }
+        return true;
+    }
+
+    SetPtr lookup(const std::string& key, const SetRegistry& registry)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it == entries.end())
+        {
+            missCount++;
+            return nullptr;
+        }
+        if (!valid(it->second, registry))
+        {
+            usedBytes -= it->second.bytes;
+            entries.erase(it);
+            missCount++;
+            return nullptr;
+        }
+        it->second.lastUse = ++useClock;
+        hitCount++;
+        return it->second.result;
+    }
+
+    void store(const Context& context, int node, const SetPtr& result)
+    {
+        std::vector<int> ids;
+        collectDependencies(context.formula.tree(), node, ids);
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        Entry entry;
+        entry.result = result;
+        for (int id : ids) entry.dependencies.push_back({ id, context.registry.version(id) });
+        entry.bytes = result->memoryBytes() + context.keys[node].size();
+
+        std::lock_guard<std::mutex> guard(lock);
+        entry.lastUse = ++useClock;
+        auto it = entries.find(context.keys[node]);
+        if (it != entries.end()) usedBytes -= it->second.bytes;
+        usedBytes += entry.bytes;
+        entries[context.keys[node]] = std::move(entry);
+        evictToBudget();
+    }
+
+    // Вытеснение давно не использованных записей при превышении бюджета памяти (вызывается под блокировкой)
+    void evictToBudget()
+    {
+        while (usedBytes > budgetBytes && !entries.empty())
+        {
+            auto oldest = entries.begin();
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                if (it->second.lastUse < oldest->second.lastUse) oldest = it;
+            }
+            usedBytes -= oldest->second.bytes;
+            entries.erase(oldest);
+        }
+    }
+
+    // Программа поддерева, в которой уже закэшированные подвыражения заменены готовыми результатами.
+    // Такие операнды получают отрицательные номера: -1 - первый результат в temps, -2 - второй и т.д.
+    void emitWithCachedOperands(Context& context, int node, bool isRoot, std::vector<FormulaInstruction>& program, std::vector<SetPtr>& temps)
+    {
+        const FormulaNode& n = context.formula.tree()[node];
+        if (!isRoot && n.left >= 0)
+        {
+            SetPtr cached = lookup(context.keys[node], context.registry);
+            if (cached)
+            {
+                temps.push_back(cached);
+                program.push_back({ FormulaOp::Set, -static_cast<int>(temps.size()) });
+                return;
+            }
+        }
+        if (n.left >= 0) emitWithCachedOperands(context, n.left, false, program, temps);
+        if (n.right >= 0) emitWithCachedOperands(context, n.right, false, program, temps);
+        program.push_back({ n.op, n.operand });
+    }
+
+    // Результат поддерева: из кэша или слитным вычислением с последующим сохранением
+    SetPtr evaluateUnit(Context& context, int node)
+    {
+        const FormulaNode& n = context.formula.tree()[node];
+        if (n.op == FormulaOp::Set)
+        {
+            // Множество реестра используется на месте, без копирования и без записи в кэш
+            return SetPtr(SetPtr(), &context.registry.at(n.operand));
+        }
+
+        SetPtr cached = lookup(context.keys[node], context.registry);
+        if (cached) return cached;
+
+        std::vector<FormulaInstruction> program;
+        std::vector<SetPtr> temps;
+        emitWithCachedOperands(context, node, true, program, temps);
+
+        const SetRegistry& registry = context.registry;
+        auto setAt = [&](int operand) -> const RoaringSet&
+        {
+            return operand >= 0 ? registry.at(operand) : *temps[-operand - 1];
+        };
+        RoaringSet value;
+        if (!FusedEvaluator::worthFusing(program, setAt)) value = Formula::runStepwise(program, setAt, context.universeMin, context.universeMax);
+        else if (pool) value = ParallelSetOps::evaluate(*pool, program, setAt, context.universeMin, context.universeMax);
+        else value = FusedEvaluator::evaluate(program, setAt, context.universeMin, context.universeMax);
+
+        SetPtr result = std::make_shared<const RoaringSet>(std::move(value));
+        if (n.op != FormulaOp::Empty && n.op != FormulaOp::Universe) store(context, node, result);
+        return result;
+    }
+
+    // Дополнения можно поднять к корню (FormulaSimplifier::pullComplements): в формуле есть
+    // дополнение или универсум, а все множества лежат в универсуме, так что тождества верны
+    static bool liftable(const Formula& formula, const SetRegistry& registry, int universeMin, int universeMax)
+    {
+        bool complemented = false;
+        for (const FormulaNode& n : formula.tree())
+        {
+            if (n.op == FormulaOp::Complement || n.op == FormulaOp::Universe) complemented = true;
+            if (n.op == FormulaOp::Set && !registry.at(n.operand).within(universeMin, universeMax)) return false;
+        }
+        return complemented;
+    }
+
+    // Канонические ключи всех узлов формулы; результаты с дополнением зависят от универсума, поэтому он входит в ключ
+    Context prepare(const Formula& formula, const SetRegistry& registry, int universeMin, int universeMax) const
+    {
+        Context context{ formula, registry, universeMin, universeMax, std::vector<std::string>(formula.tree().size()) };
+        buildKeys(formula.tree(), formula.root(), context.keys);
+        std::string prefix = "[" + std::to_string(universeMin) + "," + std::to_string(universeMax) + "]";
+        for (std::string& key : context.keys)
+        {
+            if (!key.empty()) key = prefix + key;
+        }
+        return context;
+    }
+
+public:
+    FormulaCache(size_t budget = DefaultBudget, ThreadPool* threads = nullptr)
+        : budgetBytes(budget), usedBytes(0), useClock(0), hitCount(0), missCount(0), pool(threads)
+    {
+    }
+
+    // Вычисление формулы с использованием кэша.
+    // Корень бинарной операции собирается из отдельно закэшированных операндов, поэтому
+    // близкие варианты одной формулы (меняется один из операндов) переиспользуют другой операнд.
+    SetPtr evaluate(const Formula& formula, const SetRegistry& registry, int universeMin, int universeMax)
+    {
+        Context context = prepare(formula, registry, universeMin, universeMax);
+        int root = formula.root();
+        const FormulaNode& n = formula.tree()[root];
+        if (!isBinary(n.op)) return evaluateUnit(context, root);
+
+        SetPtr cached = lookup(context.keys[root], registry);
+        if (cached) return cached;
+
+        SetPtr left = evaluateUnit(context, n.left);
+        SetPtr right = evaluateUnit(context, n.right);
+        SetOperation op = toSetOperation(n.op);
+        SetPtr result = std::make_shared<const RoaringSet>(pool ? ParallelSetOps::combine(*pool, *left, *right, op) : RoaringSet::combine(*left, *right, op));
+        store(context, root, result);
+        return result;
+    }
+
+    // Вычисление формулы с отложенным дополнением: результат - множество или дополнение множества,
+    // которое строится только при перечислении элементов. Так !A или !(A*B)+C над огромным
+    // универсумом стоят столько же, сколько A или (A*B)-C
+    SetHandle evaluateHandle(const Formula& formula, const SetRegistry& registry, int universeMin, int universeMax)
+    {
+        if (!liftable(formula, registry, universeMin, universeMax)) return SetHandle(evaluate(formula, registry, universeMin, universeMax), universeMin, universeMax);
+        bool negated;
+        Formula positive = FormulaSimplifier::pullComplements(formula, negated);
+        SetPtr base = evaluate(positive, registry, universeMin, universeMax);
+        return negated ? SetHandle::complementOf(base, universeMin, universeMax) : SetHandle(base, universeMin, universeMax);
+    }
+
+    // Мощность результата формулы. Корневая операция не выполняется: мощность считается
+    // по операндам (через мощность их пересечения), поэтому результат не строится.
+    // Дополнения поднимаются к корню: |!X| = |U| - |X|.
+    uint64_t count(const Formula& formula, const SetRegistry& registry, int universeMin, int universeMax)
+    {
+        uint64_t universeSize = static_cast<uint64_t>(static_cast<long long>(universeMax) - universeMin + 1);
+        if (liftable(formula, registry, universeMin, universeMax))
+        {
+            bool negated;
+            uint64_t size = count(FormulaSimplifier::pullComplements(formula, negated), registry, universeMin, universeMax);
+            return negated ? universeSize - size : size;
+        }
+
+        Context context = prepare(formula, registry, universeMin, universeMax);
+        int root = formula.root();
+        const FormulaNode& n = formula.tree()[root];
+        switch (n.op)
+        {
+        case FormulaOp::Set: return registry.at(n.operand).size();
+        case FormulaOp::Empty: return 0;
+        case FormulaOp::Universe: return universeSize;
+        default: break;
+        }
+
+        SetPtr cached = lookup(context.keys[root], registry);
+        if (cached) return cached->size();
+
+        if (n.op == FormulaOp::Complement)
+        {
+            // |!X| = |U| - |X*U|: элементы X вне универсума в дополнение не входят
+            RoaringSet universe;
+            universe.addRange(universeMin, universeMax);
+            return universeSize - RoaringSet::intersectionSize(*evaluateUnit(context, n.left), universe);
+        }
+        return RoaringSet::combinedSize(*evaluateUnit(context, n.left), *evaluateUnit(context, n.right), toSetOperation(n.op));
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        entries.clear();
+        usedBytes = 0;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return entries.size();
+    }
+
+    size_t memoryBytes() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return usedBytes;
+    }
+
+    size_t hits() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return hitCount;
+    }
+
+    size_t misses() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return missCount;
+    }
+};
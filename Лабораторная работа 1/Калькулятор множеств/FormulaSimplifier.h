@@ -0,0 +1,373 @@
+﻿#pragma once
+
+#include <functional>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "SetFormula.h"
+
+// Упрощение формулы по тождествам алгебры множеств перед вычислением.
+// Дерево перестраивается снизу вверх; одинаковые поддеревья сливаются в один узел
+// (hash-consing), поэтому структурное равенство поддеревьев - это равенство индексов.
+// У коммутативных операций операнды упорядочиваются, так что A*B и B*A совпадают,
+// а цепочки объединений и пересечений упрощаются как списки операндов.
+// Применяемые правила:
+//   - константы: X+{} = X, X*U = X, X*{} = {}, X+U = U, X-U = {}, X^{} = X, X^U = !X, !{} = U, !U = {};
+//   - идемпотентность и взаимоуничтожение: X*X = X, X+X = X, X-X = {}, X^X = {};
+//   - дополнение: !!X = X, X*!X = {}, X+!X = U, X^!X = U, !X^!Y = X^Y;
+//   - законы де Моргана: дополнения опускаются к листьям (!(X+Y) = !X*!Y, !(X*Y) = !X+!Y,
+//     !(X-Y) = !X+Y, !(X^Y) = !X^Y);
+//   - исключение дополнений: X*!Y = X-Y, X-!Y = X*Y, U-X = !X;
+//   - поглощение: X+(X*Y) = X, X*(X+Y) = X, X+(X-Y) = X, X*(X-Y) = X-Y, X-(X+Y) = {}, (X-Y)-Y = X-Y.
+// Дополнение берётся до универсума (!X = U \ X), а именованное множество может выходить за U
+// (после сужения универсума или загрузки). Поэтому правила с U и дополнением, верные только
+// для X внутри U (X*U = X, !!X = X, X+!X = U, X^!X = U, X-!Y = X*Y, ...), применяются, лишь когда
+// это известно: для каждого узла отмечается, лежит ли он в U (множество - по проверке вызывающего,
+// дополнение и универсум - всегда, объединение - если оба операнда, пересечение - если хотя бы один).
+// Для вычисления pullComplements, наоборот, поднимает оставшиеся дополнения к корню формулы.
+class FormulaSimplifier
+{
+public:
+    // Лежит ли множество с данным номером в текущем универсуме
+    typedef std::function<bool(int)> InUniverse;
+
+private:
+    const Formula& source;
+    InUniverse setInUniverse;
+    std::vector<FormulaNode> nodes;
+    std::vector<char> inside;   // Значение узла nodes[i] лежит в универсуме
+    std::map<std::tuple<int, int, int, int>, int> interned;
+
+    FormulaSimplifier(const Formula& formula, InUniverse inUniverse) : source(formula), setInUniverse(std::move(inUniverse))
+    {
+    }
+
+    // Лежит ли в универсуме результат операции op над узлами left и right
+    bool computeInside(FormulaOp op, int operand, int left, int right) const
+    {
+        switch (op)
+        {
+        case FormulaOp::Set: return setInUniverse && setInUniverse(operand);
+        case FormulaOp::Empty:
+        case FormulaOp::Universe:
+        case FormulaOp::Complement: return true;
+        case FormulaOp::Union:
+        case FormulaOp::SymmetricDifference: return inside[left] && inside[right];
+        case FormulaOp::Intersection: return inside[left] || inside[right];
+        case FormulaOp::Difference: return inside[left] != 0;
+        }
+        return false;
+    }
+
+    static bool commutative(FormulaOp op)
+    {
+        return op == FormulaOp::Union || op == FormulaOp::Intersection || op == FormulaOp::SymmetricDifference;
+    }
+
+    // Узел без применения правил (с поиском уже существующего такого же узла)
+    int intern(FormulaOp op, int operand, int left, int right)
+    {
+        if (commutative(op) && right < left) std::swap(left, right);
+        auto key = std::make_tuple(static_cast<int>(op), operand, left, right);
+        auto it = interned.find(key);
+        if (it != interned.end()) return it->second;
+        inside.push_back(computeInside(op, operand, left, right));
+        nodes.push_back({ op, operand, left, right });
+        int index = static_cast<int>(nodes.size()) - 1;
+        interned[key] = index;
+        return index;
+    }
+
+    bool is(int node, FormulaOp op) const
+    {
+        return nodes[node].op == op;
+    }
+
+    // node имеет вид op(x, ...) или op(..., x) для коммутативной операции
+    bool hasOperand(int node, FormulaOp op, int x) const
+    {
+        const FormulaNode& n = nodes[node];
+        if (n.op != op) return false;
+        return n.left == x || (commutative(op) && n.right == x);
+    }
+
+    // Узлы x и y - дополнения друг друга
+    bool complementary(int x, int y) const
+    {
+        return (is(x, FormulaOp::Complement) && nodes[x].left == y) || (is(y, FormulaOp::Complement) && nodes[y].left == x);
+    }
+
+    int empty()
+    {
+        return intern(FormulaOp::Empty, -1, -1, -1);
+    }
+
+    int universe()
+    {
+        return intern(FormulaOp::Universe, -1, -1, -1);
+    }
+
+    int complement(int x)
+    {
+        const FormulaNode n = nodes[x];
+        switch (n.op)
+        {
+        case FormulaOp::Empty: return universe();
+        case FormulaOp::Universe: return empty();
+        case FormulaOp::Complement: if (inside[n.left]) return n.left; break;
+        case FormulaOp::Union: return intersection(complement(n.left), complement(n.right));
+        case FormulaOp::Intersection: return unite(complement(n.left), complement(n.right));
+        // !(X-Y) = !X+Y и !(X^Y) = !X^Y верны, если Y лежит в U
+        case FormulaOp::Difference: if (inside[n.right]) return unite(complement(n.left), n.right); break;
+        case FormulaOp::SymmetricDifference: if (inside[n.right]) return symmetricDifference(complement(n.left), n.right); break;
+        default: break;
+        }
+        return intern(FormulaOp::Complement, -1, x, -1);
+    }
+
+    // Операнды цепочки одинаковых ассоциативных операций: (x+y)+z -> [x, y, z]
+    void flatten(int node, FormulaOp op, std::vector<int>& operands) const
+    {
+        if (is(node, op))
+        {
+            flatten(nodes[node].left, op, operands);
+            flatten(nodes[node].right, op, operands);
+        }
+        else
+        {
+            operands.push_back(node);
+        }
+    }
+
+    // Левоассоциативная цепочка из отсортированных операндов
+    int chain(FormulaOp op, const std::vector<int>& operands)
+    {
+        int result = operands[0];
+        for (size_t i = 1; i < operands.size(); i++) result = intern(op, -1, result, operands[i]);
+        return result;
+    }
+
+    static bool listed(const std::vector<int>& operands, int node)
+    {
+        return std::binary_search(operands.begin(), operands.end(), node);
+    }
+
+    // Операнд поглощается другим операндом списка: для объединения x + (x*z) и x + (x-z), для пересечения x * (x+z)
+    bool absorbed(int node, FormulaOp op, const std::vector<int>& operands) const
+    {
+        FormulaOp absorbing = op == FormulaOp::Union ? FormulaOp::Intersection : FormulaOp::Union;
+        std::vector<int> inner;
+        flatten(node, absorbing, inner);
+        if (inner.size() > 1)
+        {
+            for (int x : inner)
+            {
+                if (x != node && listed(operands, x)) return true;
+            }
+        }
+        return op == FormulaOp::Union && is(node, FormulaOp::Difference) && listed(operands, nodes[node].left);
+    }
+
+    // Объединение и пересечение упрощаются над всем списком операндов цепочки,
+    // чтобы тождества срабатывали и для несоседних операндов: A*(B+C)*B = A*B
+    int associative(FormulaOp op, int x, int y)
+    {
+        bool isUnion = op == FormulaOp::Union;
+        FormulaOp neutral = isUnion ? FormulaOp::Empty : FormulaOp::Universe;
+        FormulaOp dominant = isUnion ? FormulaOp::Universe : FormulaOp::Empty;
+
+        std::vector<int> operands;
+        flatten(x, op, operands);
+        flatten(y, op, operands);
+        std::sort(operands.begin(), operands.end());
+        operands.erase(std::unique(operands.begin(), operands.end()), operands.end());
+
+        // X+U = U и X+!X = U верны, только если все операнды объединения лежат в U
+        bool allInside = true;
+        for (int node : operands) allInside = allInside && inside[node];
+
+        std::vector<int> kept;
+        bool universeKept = false;
+        for (int node : operands)
+        {
+            if (is(node, dominant) && (!isUnion || allInside)) return isUnion ? universe() : empty();
+            if (is(node, FormulaOp::Complement) && listed(operands, nodes[node].left) && (!isUnion || allInside)) return isUnion ? universe() : empty();
+            // X*U = X*U, если ни один другой операнд пересечения не лежит в U
+            if (is(node, neutral) && !isUnion)
+            {
+                universeKept = true;
+                continue;
+            }
+            if (is(node, neutral) || absorbed(node, op, operands)) continue;
+            // x * (x-z) = x-z: операнд x лишний, если в списке есть разность с уменьшаемым x
+            bool redundant = false;
+            if (!isUnion)
+            {
+                for (int other : operands)
+                {
+                    if (is(other, FormulaOp::Difference) && nodes[other].left == node) redundant = true;
+                }
+            }
+            if (!redundant) kept.push_back(node);
+        }
+        if (kept.empty()) return isUnion ? empty() : universe();
+
+        if (!isUnion)
+        {
+            bool keptInside = false;
+            for (int node : kept) keptInside = keptInside || inside[node];
+            if (universeKept && !keptInside)
+            {
+                kept.push_back(universe());
+                std::sort(kept.begin(), kept.end());
+                keptInside = true;
+            }
+            // x * !a * !b = (x - a) - b: дополнения вычитаются из пересечения остальных операндов
+            std::vector<int> positive, negated;
+            for (int node : kept)
+            {
+                if (is(node, FormulaOp::Complement)) negated.push_back(nodes[node].left);
+                else positive.push_back(node);
+            }
+            bool positiveInside = false;
+            for (int node : positive) positiveInside = positiveInside || inside[node];
+            if (!positive.empty() && !negated.empty() && positiveInside)
+            {
+                int result = chain(op, positive);
+                for (int node : negated) result = difference(result, node);
+                return result;
+            }
+        }
+        return chain(op, kept);
+    }
+
+    int unite(int x, int y)
+    {
+        return associative(FormulaOp::Union, x, y);
+    }
+
+    int intersection(int x, int y)
+    {
+        return associative(FormulaOp::Intersection, x, y);
+    }
+
+    int difference(int x, int y)
+    {
+        if (x == y) return empty();
+        if (is(x, FormulaOp::Empty) || (is(y, FormulaOp::Universe) && inside[x])) return empty();
+        if (is(y, FormulaOp::Empty)) return x;
+        if (is(x, FormulaOp::Universe)) return complement(y);
+        if (is(y, FormulaOp::Complement) && inside[x]) return intersection(x, nodes[y].left);
+        if (is(x, FormulaOp::Complement) && nodes[x].left == y) return x;
+        // x - (x+z) = {}, (x*z) - x = {}, (x-z) - x = {}
+        if (hasOperand(y, FormulaOp::Union, x)) return empty();
+        if (hasOperand(x, FormulaOp::Intersection, y) || hasOperand(x, FormulaOp::Difference, y)) return empty();
+        // (x-z) - z = x-z
+        if (is(x, FormulaOp::Difference) && nodes[x].right == y) return x;
+        return intern(FormulaOp::Difference, -1, x, y);
+    }
+
+    int symmetricDifference(int x, int y)
+    {
+        if (x == y) return empty();
+        if (is(x, FormulaOp::Empty)) return y;
+        if (is(y, FormulaOp::Empty)) return x;
+        if (is(x, FormulaOp::Universe) && inside[y]) return complement(y);
+        if (is(y, FormulaOp::Universe) && inside[x]) return complement(x);
+        if (complementary(x, y) && inside[x] && inside[y]) return universe();
+        if (is(x, FormulaOp::Complement) && is(y, FormulaOp::Complement) && inside[nodes[x].left] && inside[nodes[y].left])
+        {
+            return symmetricDifference(nodes[x].left, nodes[y].left);
+        }
+        return intern(FormulaOp::SymmetricDifference, -1, x, y);
+    }
+
+    // Перенос поддерева исходной формулы с упрощением
+    int rebuild(int node)
+    {
+        const FormulaNode& n = source.tree()[node];
+        switch (n.op)
+        {
+        case FormulaOp::Set: return intern(FormulaOp::Set, n.operand, -1, -1);
+        case FormulaOp::Empty: return empty();
+        case FormulaOp::Universe: return universe();
+        case FormulaOp::Complement: return complement(rebuild(n.left));
+        case FormulaOp::Union: return unite(rebuild(n.left), rebuild(n.right));
+        case FormulaOp::Intersection: return intersection(rebuild(n.left), rebuild(n.right));
+        case FormulaOp::Difference: return difference(rebuild(n.left), rebuild(n.right));
+        case FormulaOp::SymmetricDifference: return symmetricDifference(rebuild(n.left), rebuild(n.right));
+        }
+        return -1;
+    }
+
+    // Поддерево без дополнений: значение узла равно first или, если second, его дополнению.
+    // Дополнения поднимаются вверх по тождествам withComplements (A*!B = A-B, !A+!B = !(A*B), ...),
+    // универсум записывается как дополнение пустого множества
+    std::pair<int, bool> positive(int node)
+    {
+        const FormulaNode& n = source.tree()[node];
+        switch (n.op)
+        {
+        case FormulaOp::Set: return { intern(FormulaOp::Set, n.operand, -1, -1), false };
+        case FormulaOp::Empty: return { empty(), false };
+        case FormulaOp::Universe: return { empty(), true };
+        case FormulaOp::Complement:
+        {
+            std::pair<int, bool> inner = positive(n.left);
+            return { inner.first, !inner.second };
+        }
+        default:
+        {
+            std::pair<int, bool> left = positive(n.left);
+            std::pair<int, bool> right = positive(n.right);
+            ComplementedOperation plan = withComplements(toSetOperation(n.op), left.second, right.second);
+            int x = plan.swapped ? right.first : left.first;
+            int y = plan.swapped ? left.first : right.first;
+            return { intern(toFormulaOp(plan.op), -1, x, y), plan.negated };
+        }
+        }
+    }
+
+    // Копирование только достижимых из корня узлов
+    static int compact(const std::vector<FormulaNode>& from, int node, std::vector<FormulaNode>& to, std::map<int, int>& moved)
+    {
+        auto it = moved.find(node);
+        if (it != moved.end()) return it->second;
+        FormulaNode copy = from[node];
+        if (copy.left >= 0) copy.left = compact(from, copy.left, to, moved);
+        if (copy.right >= 0) copy.right = compact(from, copy.right, to, moved);
+        to.push_back(copy);
+        int index = static_cast<int>(to.size()) - 1;
+        moved[node] = index;
+        return index;
+    }
+
+    Formula compacted(int root, const Formula& formula) const
+    {
+        std::vector<FormulaNode> reachable;
+        std::map<int, int> moved;
+        int newRoot = compact(nodes, root, reachable, moved);
+        return Formula::fromTree(reachable, newRoot, formula.names());
+    }
+
+public:
+    // Упрощённая формула; inUniverse сообщает, какие множества лежат в универсуме
+    static Formula simplify(const Formula& formula, InUniverse inUniverse)
+    {
+        FormulaSimplifier simplifier(formula, std::move(inUniverse));
+        int root = simplifier.rebuild(formula.root());
+        return simplifier.compacted(root, formula);
+    }
+
+    // Формула без дополнений и универсума, значение которой равно исходному (negated = false)
+    // или его дополнению (negated = true). Дополнение корня можно не строить (см. SetHandle.h)
+    static Formula pullComplements(const Formula& formula, bool& negated)
+    {
+        FormulaSimplifier simplifier(formula, nullptr);
+        std::pair<int, bool> root = simplifier.positive(formula.root());
+        negated = root.second;
+        return simplifier.compacted(root.first, formula);
+    }
+};
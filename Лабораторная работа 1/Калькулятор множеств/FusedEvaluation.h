@@ -0,0 +1,262 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include "RoaringSet.h"
+#include "SetFormula.h"
+
+// Слитное вычисление постфиксной программы формулы без промежуточных множеств.
+// Сначала по ключам блоков определяется, в каких блоках результат может быть непустым.
+// Затем каждый такой блок проходится один раз порциями по BlockWords слов: стек программы
+// состоит из нескольких порций по 512 байт, которые целиком помещаются в кэш L1,
+// а в память записывается только итоговый контейнер блока.
+class FusedEvaluator
+{
+public:
+    static const int BlockWords = 64;
+    static const int ChunkWords = Container::ChunkBitmap::WordCount;
+
+private:
+    // Операнд-множество программы и его положение внутри текущего блока
+    struct Leaf
+    {
+        const RoaringSet* set;
+        const Container* container;
+        size_t cursor;
+    };
+
+    // Объединение, пересечение или разность отсортированных списков ключей
+    static std::vector<uint16_t> combineKeys(const std::vector<uint16_t>& a, const std::vector<uint16_t>& b, SetOperation op)
+    {
+        std::vector<uint16_t> result;
+        if (op == SetOperation::Difference) return a;
+        if (op == SetOperation::Intersection)
+        {
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        }
+        else
+        {
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        }
+        return result;
+    }
+
+    // Ключи блоков, в которых результат программы может быть непустым
+    static std::vector<uint16_t> candidateKeys(const std::vector<FormulaInstruction>& program, const std::vector<Leaf>& leaves, uint32_t firstKey, uint32_t lastKey)
+    {
+        std::vector<uint16_t> universeKeys;
+        for (uint32_t key = firstKey; key <= lastKey; key++) universeKeys.push_back(static_cast<uint16_t>(key));
+
+        std::vector<std::vector<uint16_t>> stack;
+        size_t leafIndex = 0;
+        for (const FormulaInstruction& instruction : program)
+        {
+            switch (instruction.op)
+            {
+            case FormulaOp::Set:
+            {
+                const RoaringSet& set = *leaves[leafIndex++].set;
+                std::vector<uint16_t> keys(set.containerCount());
+                for (size_t i = 0; i < keys.size(); i++) keys[i] = set.keyAt(i);
+                stack.push_back(std::move(keys));
+                break;
+            }
+            case FormulaOp::Empty:
+                stack.push_back(std::vector<uint16_t>());
+                break;
+            case FormulaOp::Universe:
+            case FormulaOp::Complement:
+                if (instruction.op == FormulaOp::Complement) stack.pop_back();
+                stack.push_back(universeKeys);
+                break;
+            default:
+            {
+                std::vector<uint16_t> right = std::move(stack.back());
+                stack.pop_back();
+                stack.back() = combineKeys(stack.back(), right, toSetOperation(instruction.op));
+                break;
+            }
+            }
+        }
+        return stack.back();
+    }
+
+    static int stackDepth(const std::vector<FormulaInstruction>& program)
+    {
+        int depth = 0, maxDepth = 0;
+        for (const FormulaInstruction& instruction : program)
+        {
+            if (instruction.op == FormulaOp::Set || instruction.op == FormulaOp::Empty || instruction.op == FormulaOp::Universe) depth++;
+            else if (isBinary(instruction.op)) depth--;
+            maxDepth = std::max(maxDepth, depth);
+        }
+        return maxDepth;
+    }
+
+public:
+    // Слияние окупается, когда в программе больше одной операции и операнды достаточно плотные:
+    // пословный проход стоит ChunkWords слов на блок, а ядра пар контейнеров - порядка числа
+    // элементов, поэтому для редких множеств пооперационное вычисление быстрее
+    static const int DenseBlockElements = ChunkWords;
+
+    template <typename SetLookup>
+    static bool worthFusing(const std::vector<FormulaInstruction>& program, SetLookup setAt)
+    {
+        int operations = 0;
+        uint64_t elements = 0, blocks = 0;
+        for (const FormulaInstruction& instruction : program)
+        {
+            if (instruction.op == FormulaOp::Complement || isBinary(instruction.op)) operations++;
+            if (instruction.op == FormulaOp::Set)
+            {
+                const RoaringSet& set = setAt(instruction.operand);
+                elements += set.size();
+                blocks += set.containerCount();
+            }
+        }
+        return operations > 1 && elements >= blocks * DenseBlockElements;
+    }
+
+    // Ключи блоков, в которых результат программы может быть непустым
+    template <typename SetLookup>
+    static std::vector<uint16_t> resultKeys(const std::vector<FormulaInstruction>& program, SetLookup setAt, int universeMin, int universeMax)
+    {
+        std::vector<Leaf> leaves;
+        for (const FormulaInstruction& instruction : program)
+        {
+            if (instruction.op == FormulaOp::Set) leaves.push_back({ &setAt(instruction.operand), nullptr, 0 });
+        }
+        uint32_t from = RoaringSet::toUnsigned(universeMin), to = RoaringSet::toUnsigned(universeMax);
+        return candidateKeys(program, leaves, from >> 16, to >> 16);
+    }
+
+    // Вычисление программы над множествами setAt(номер) в универсуме [universeMin, universeMax].
+    // firstKey и lastKey ограничивают обрабатываемые блоки: так вычисление делится между потоками.
+    template <typename SetLookup>
+    static RoaringSet evaluate(const std::vector<FormulaInstruction>& program, SetLookup setAt, int universeMin, int universeMax,
+        uint16_t firstKey = 0, uint16_t lastKey = 65535)
+    {
+        std::vector<Leaf> leaves;
+        for (const FormulaInstruction& instruction : program)
+        {
+            if (instruction.op == FormulaOp::Set) leaves.push_back({ &setAt(instruction.operand), nullptr, 0 });
+        }
+
+        uint32_t from = RoaringSet::toUnsigned(universeMin), to = RoaringSet::toUnsigned(universeMax);
+        std::vector<uint16_t> keys = candidateKeys(program, leaves, from >> 16, to >> 16);
+        keys.erase(std::remove_if(keys.begin(), keys.end(), [&](uint16_t key) { return key < firstKey || key > lastKey; }), keys.end());
+
+        // Рабочая память выделяется один раз на всё вычисление
+        std::vector<uint64_t> stack(static_cast<size_t>(std::max(stackDepth(program), 1)) * BlockWords);
+        std::vector<uint64_t> chunk(ChunkWords);
+        RoaringSet result;
+
+        for (uint16_t key : keys)
+        {
+            for (Leaf& leaf : leaves)
+            {
+                leaf.container = leaf.set->findContainer(key);
+                leaf.cursor = 0;
+            }
+
+            // Часть блока, принадлежащая универсуму; блоки вне универсума (элементы множеств
+            // за его границами) получают пустую маску, и дополнение в них пусто
+            bool inside = key >= (from >> 16) && key <= (to >> 16);
+            uint32_t rangeFirst = key == (from >> 16) ? (from & 0xFFFF) : 0;
+            uint32_t rangeLast = key == (to >> 16) ? (to & 0xFFFF) : 65535;
+
+            int count = 0;
+            for (int firstWord = 0; firstWord < ChunkWords; firstWord += BlockWords)
+            {
+                uint64_t rangeMask[BlockWords];
+                for (int w = 0; w < BlockWords; w++)
+                {
+                    uint32_t wordStart = static_cast<uint32_t>(firstWord + w) * 64;
+                    uint64_t mask = 0;
+                    if (inside && wordStart + 63 >= rangeFirst && wordStart <= rangeLast)
+                    {
+                        mask = ~0ULL;
+                        if (rangeFirst > wordStart) mask &= ~0ULL << (rangeFirst - wordStart);
+                        if (rangeLast < wordStart + 63) mask &= lowMask(static_cast<int>(rangeLast - wordStart) + 1);
+                    }
+                    rangeMask[w] = mask;
+                }
+
+                uint64_t* top = stack.data();
+                size_t leafIndex = 0;
+                for (const FormulaInstruction& instruction : program)
+                {
+                    switch (instruction.op)
+                    {
+                    case FormulaOp::Set:
+                    {
+                        Leaf& leaf = leaves[leafIndex++];
+                        if (leaf.container) leaf.container->loadWords(firstWord, BlockWords, top, leaf.cursor);
+                        else for (int w = 0; w < BlockWords; w++) top[w] = 0;
+                        top += BlockWords;
+                        break;
+                    }
+                    case FormulaOp::Empty:
+                        for (int w = 0; w < BlockWords; w++) top[w] = 0;
+                        top += BlockWords;
+                        break;
+                    case FormulaOp::Universe:
+                        for (int w = 0; w < BlockWords; w++) top[w] = rangeMask[w];
+                        top += BlockWords;
+                        break;
+                    case FormulaOp::Complement:
+                    {
+                        uint64_t* a = top - BlockWords;
+                        for (int w = 0; w < BlockWords; w++) a[w] = ~a[w] & rangeMask[w];
+                        break;
+                    }
+                    case FormulaOp::Union:
+                    {
+                        uint64_t* a = top - 2 * BlockWords;
+                        uint64_t* b = top - BlockWords;
+                        for (int w = 0; w < BlockWords; w++) a[w] |= b[w];
+                        top = b;
+                        break;
+                    }
+                    case FormulaOp::Intersection:
+                    {
+                        uint64_t* a = top - 2 * BlockWords;
+                        uint64_t* b = top - BlockWords;
+                        for (int w = 0; w < BlockWords; w++) a[w] &= b[w];
+                        top = b;
+                        break;
+                    }
+                    case FormulaOp::Difference:
+                    {
+                        uint64_t* a = top - 2 * BlockWords;
+                        uint64_t* b = top - BlockWords;
+                        for (int w = 0; w < BlockWords; w++) a[w] &= ~b[w];
+                        top = b;
+                        break;
+                    }
+                    case FormulaOp::SymmetricDifference:
+                    {
+                        uint64_t* a = top - 2 * BlockWords;
+                        uint64_t* b = top - BlockWords;
+                        for (int w = 0; w < BlockWords; w++) a[w] ^= b[w];
+                        top = b;
+                        break;
+                    }
+                    }
+                }
+
+                const uint64_t* value = stack.data();
+                for (int w = 0; w < BlockWords; w++)
+                {
+                    chunk[firstWord + w] = value[w];
+                    count += bitCount(value[w]);
+                }
+            }
+
+            if (count > 0) result.appendContainer(key, Container::fromWords(chunk.data(), count));
+        }
+        return result;
+    }
+};
@@ -0,0 +1,370 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <climits>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MULTISET_KERNELS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "RoaringSet.h"
+
+// Мультимножество (bag) чисел универсума [first, last]: у каждого элемента есть кратность.
+// Хранение выбирается по размеру универсума:
+//   - плотное (универсум не больше DenseLimit чисел): массив 32-битных кратностей по всем числам,
+//     операции - поэлементные ядра над массивами, по 4 кратности за инструкцию SSE2;
+//   - разреженное: отсортированные отрезки подряд идущих чисел с одинаковой кратностью (RLE),
+//     операции - слияние списков отрезков за O(число отрезков).
+// Операции: сумма (кратности складываются, с насыщением), объединение (max), пересечение (min)
+// и усечённая разность (monus: max(a - b, 0)).
+// Обычное множество - мультимножество с кратностями 1 (fromSet, assignSet);
+// обратное преобразование (support) оставляет элементы с ненулевой кратностью.
+
+enum class BagOperation
+{
+    Sum,
+    Max,
+    Min,
+    Monus
+};
+
+// Отрезок [first, last] чисел с кратностью count
+struct BagRun
+{
+    int first;
+    int last;
+    uint32_t count;
+};
+
+// Кратность результата операции для кратностей операндов a и b
+inline uint32_t applyBagOperation(BagOperation op, uint32_t a, uint32_t b)
+{
+    switch (op)
+    {
+    case BagOperation::Sum:
+    {
+        uint32_t sum = a + b;
+        return sum < a ? UINT32_MAX : sum;
+    }
+    case BagOperation::Max: return a > b ? a : b;
+    case BagOperation::Min: return a < b ? a : b;
+    case BagOperation::Monus: return a > b ? a - b : 0;
+    }
+    return 0;
+}
+
+#ifdef MULTISET_KERNELS_SSE2
+// Беззнаковое сравнение a > b по 32-битным словам: в SSE2 есть только знаковое,
+// поэтому у обоих операндов инвертируется старший бит
+inline __m128i greaterUnsigned32(__m128i a, __m128i b)
+{
+    const __m128i sign = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    return _mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
+}
+
+// Операция над четырьмя кратностями без ветвлений
+template <BagOperation Op>
+inline __m128i applyBagOperation4(__m128i a, __m128i b)
+{
+    if (Op == BagOperation::Sum)
+    {
+        // При переполнении сумма меньше слагаемого: такие слова заполняются единицами
+        __m128i sum = _mm_add_epi32(a, b);
+        return _mm_or_si128(sum, greaterUnsigned32(a, sum));
+    }
+    __m128i greater = greaterUnsigned32(a, b);
+    if (Op == BagOperation::Max) return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+    if (Op == BagOperation::Min) return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+    return _mm_and_si128(greater, _mm_sub_epi32(a, b));
+}
+#endif
+
+// Поэлементная операция над массивами кратностей длины count
+template <BagOperation Op>
+inline void combineCounts(const uint32_t* a, const uint32_t* b, uint32_t* out, size_t count)
+{
+    size_t i = 0;
+#ifdef MULTISET_KERNELS_SSE2
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), applyBagOperation4<Op>(va, vb));
+    }
+#endif
+    for (; i < count; i++) out[i] = applyBagOperation(Op, a[i], b[i]);
+}
+
+class Multiset
+{
+public:
+    // Наибольший размер универсума для плотного хранения (4 МБ кратностей)
+    static const uint64_t DenseLimit = 1u << 20;
+
+private:
+    int first;
+    int last;
+    bool dense;
+    std::vector<uint32_t> counts;   // Плотное хранение: counts[x - first]
+    std::vector<BagRun> runs;       // Разреженное: отрезки по возрастанию, соседние с равной кратностью слиты
+
+    // Добавление отрезка в конец списка со слиянием с предыдущим
+    static void appendRun(std::vector<BagRun>& list, long long from, long long to, uint32_t count)
+    {
+        if (!list.empty() && list.back().count == count && static_cast<long long>(list.back().last) + 1 == from)
+        {
+            list.back().last = static_cast<int>(to);
+            return;
+        }
+        list.push_back(BagRun{ static_cast<int>(from), static_cast<int>(to), count });
+    }
+
+    // Текущее содержимое списком отрезков (для плотного хранения строится по массиву)
+    std::vector<BagRun> runList() const
+    {
+        if (!dense) return runs;
+        std::vector<BagRun> list;
+        forEachRun([&](int from, int to, uint32_t count) { list.push_back(BagRun{ from, to, count }); });
+        return list;
+    }
+
+    // Слияние списков отрезков: на каждом участке, где кратности обоих операндов постоянны,
+    // вычисляется одна кратность результата
+    static std::vector<BagRun> combineRuns(const std::vector<BagRun>& a, const std::vector<BagRun>& b, BagOperation op)
+    {
+        std::vector<BagRun> result;
+        size_t i = 0, j = 0;
+        long long aPos = a.empty() ? 0 : a[0].first;
+        long long bPos = b.empty() ? 0 : b[0].first;
+        while (i < a.size() || j < b.size())
+        {
+            long long start = i < a.size() ? aPos : bPos;
+            if (j < b.size() && bPos < start) start = bPos;
+            bool inA = i < a.size() && aPos == start;
+            bool inB = j < b.size() && bPos == start;
+
+            // Участок кончается на конце текущего отрезка или перед началом следующего
+            long long end = LLONG_MAX;
+            if (i < a.size()) end = std::min(end, inA ? static_cast<long long>(a[i].last) : aPos - 1);
+            if (j < b.size()) end = std::min(end, inB ? static_cast<long long>(b[j].last) : bPos - 1);
+
+            uint32_t count = applyBagOperation(op, inA ? a[i].count : 0, inB ? b[j].count : 0);
+            if (count > 0) appendRun(result, start, end, count);
+
+            if (inA)
+            {
+                if (a[i].last == end && ++i < a.size()) aPos = a[i].first;
+                else aPos = end + 1;
+            }
+            if (inB)
+            {
+                if (b[j].last == end && ++j < b.size()) bPos = b[j].first;
+                else bPos = end + 1;
+            }
+        }
+        return result;
+    }
+
+    static void combineDense(const uint32_t* a, const uint32_t* b, uint32_t* out, size_t count, BagOperation op)
+    {
+        switch (op)
+        {
+        case BagOperation::Sum: combineCounts<BagOperation::Sum>(a, b, out, count); break;
+        case BagOperation::Max: combineCounts<BagOperation::Max>(a, b, out, count); break;
+        case BagOperation::Min: combineCounts<BagOperation::Min>(a, b, out, count); break;
+        case BagOperation::Monus: combineCounts<BagOperation::Monus>(a, b, out, count); break;
+        }
+    }
+
+public:
+    // Пустое мультимножество универсума [from, to]
+    Multiset(int from, int to)
+        : first(from), last(to), dense(static_cast<uint64_t>(static_cast<long long>(to) - from + 1) <= DenseLimit)
+    {
+        if (dense) counts.assign(static_cast<size_t>(static_cast<long long>(to) - from + 1), 0);
+    }
+
+    int minValue() const
+    {
+        return first;
+    }
+
+    int maxValue() const
+    {
+        return last;
+    }
+
+    bool isDense() const
+    {
+        return dense;
+    }
+
+    // Мультимножество с кратностью 1 у каждого элемента set (элементы вне универсума отбрасываются)
+    static Multiset fromSet(const RoaringSet& set, int from, int to)
+    {
+        Multiset result(from, to);
+        result.assignSet(set);
+        return result;
+    }
+
+    // Замена содержимого элементами set с кратностью 1. Память хранилища переиспользуется:
+    // при плотном хранении новая память не выделяется никогда, при разреженном - если
+    // старого списка отрезков хватает
+    void assignSet(const RoaringSet& set)
+    {
+        if (dense)
+        {
+            std::fill(counts.begin(), counts.end(), 0);
+            set.forEach([&](int value)
+            {
+                if (value >= first && value <= last) counts[static_cast<size_t>(static_cast<long long>(value) - first)] = 1;
+            });
+            return;
+        }
+        runs.clear();
+        set.forEach([&](int value)
+        {
+            if (value >= first && value <= last) appendRun(runs, value, value, 1);
+        });
+    }
+
+    // Добавление count к кратностям чисел отрезка [from, to] (отрезок должен лежать в универсуме)
+    void addRange(int from, int to, uint32_t count)
+    {
+        if (dense)
+        {
+            for (long long x = from; x <= to; x++)
+            {
+                uint32_t& slot = counts[static_cast<size_t>(x - first)];
+                slot = applyBagOperation(BagOperation::Sum, slot, count);
+            }
+            return;
+        }
+        // Меняются только отрезки, пересекающие [from, to] или примыкающие к нему (с ними возможно
+        // слияние): они находятся двоичным поиском и заменяются на месте, остальной список не трогается
+        auto lower = std::lower_bound(runs.begin(), runs.end(), static_cast<long long>(from) - 1,
+            [](const BagRun& run, long long x) { return run.last < x; });
+        auto upper = std::upper_bound(lower, runs.end(), static_cast<long long>(to) + 1,
+            [](long long x, const BagRun& run) { return x < run.first; });
+        std::vector<BagRun> merged = combineRuns(std::vector<BagRun>(lower, upper), std::vector<BagRun>(1, BagRun{ from, to, count }), BagOperation::Sum);
+        size_t replaced = static_cast<size_t>(upper - lower);
+        size_t common = std::min(replaced, merged.size());
+        std::copy(merged.begin(), merged.begin() + common, lower);
+        if (merged.size() > replaced) runs.insert(lower + common, merged.begin() + common, merged.end());
+        else runs.erase(lower + common, upper);
+    }
+
+    // Кратность числа value
+    uint32_t count(int value) const
+    {
+        if (value < first || value > last) return 0;
+        if (dense) return counts[static_cast<size_t>(static_cast<long long>(value) - first)];
+        auto it = std::upper_bound(runs.begin(), runs.end(), value, [](int x, const BagRun& run) { return x < run.first; });
+        if (it == runs.begin()) return 0;
+        --it;
+        return value <= it->last ? it->count : 0;
+    }
+
+    // Отрезки одинаковой ненулевой кратности по возрастанию: func(from, to, count)
+    template <typename Func>
+    void forEachRun(Func func) const
+    {
+        if (!dense)
+        {
+            for (const BagRun& run : runs) func(run.first, run.last, run.count);
+            return;
+        }
+        size_t n = counts.size();
+        for (size_t i = 0; i < n; )
+        {
+            if (counts[i] == 0)
+            {
+                i++;
+                continue;
+            }
+            size_t j = i + 1;
+            while (j < n && counts[j] == counts[i]) j++;
+            func(static_cast<int>(first + static_cast<long long>(i)), static_cast<int>(first + static_cast<long long>(j - 1)), counts[i]);
+            i = j;
+        }
+    }
+
+    // Мощность с учётом кратностей
+    uint64_t size() const
+    {
+        uint64_t total = 0;
+        forEachRun([&](int from, int to, uint32_t count)
+        {
+            total += static_cast<uint64_t>(static_cast<long long>(to) - from + 1) * count;
+        });
+        return total;
+    }
+
+    // Множество элементов с ненулевой кратностью
+    RoaringSet support() const
+    {
+        RoaringSet result;
+        uint32_t key = 0;
+        std::vector<Run> chunkRuns;
+        auto flush = [&]()
+        {
+            if (chunkRuns.empty()) return;
+            Container container = Container::fromRuns(std::move(chunkRuns));
+            container.optimize();
+            result.appendContainer(static_cast<uint16_t>(key), std::move(container));
+            chunkRuns.clear();
+        };
+        // Соседние отрезки с разной кратностью сливаются в один отрезок множества
+        forEachRun([&](int from, int to, uint32_t)
+        {
+            uint32_t low = RoaringSet::toUnsigned(from), high = RoaringSet::toUnsigned(to);
+            while (low <= high)
+            {
+                uint32_t lowKey = low >> 16;
+                uint32_t chunkEnd = std::min(high, (lowKey << 16) | 0xFFFF);
+                if (lowKey != key) flush();
+                key = lowKey;
+                if (!chunkRuns.empty() && static_cast<uint32_t>(chunkRuns.back().last) + 1 == (low & 0xFFFF))
+                {
+                    chunkRuns.back().last = static_cast<uint16_t>(chunkEnd & 0xFFFF);
+                }
+                else
+                {
+                    chunkRuns.push_back(Run{ static_cast<uint16_t>(low & 0xFFFF), static_cast<uint16_t>(chunkEnd & 0xFFFF) });
+                }
+                if (chunkEnd == 0xFFFFFFFFu) break;
+                low = chunkEnd + 1;
+            }
+        });
+        flush();
+        return result;
+    }
+
+    // Операция над мультимножествами. Плотные операнды одного универсума обрабатываются
+    // поэлементными ядрами, остальные - слиянием отрезков (результат тогда разреженный
+    // в объединении универсумов операндов)
+    static Multiset combine(const Multiset& a, const Multiset& b, BagOperation op)
+    {
+        if (a.dense && b.dense && a.first == b.first && a.last == b.last)
+        {
+            Multiset result(a.first, a.last);
+            combineDense(a.counts.data(), b.counts.data(), result.counts.data(), a.counts.size(), op);
+            return result;
+        }
+        Multiset result(std::min(a.first, b.first), std::max(a.last, b.last));
+        std::vector<BagRun> merged = combineRuns(a.runList(), b.runList(), op);
+        if (result.dense)
+        {
+            for (const BagRun& run : merged) result.addRange(run.first, run.last, run.count);
+        }
+        else
+        {
+            result.runs = std::move(merged);
+        }
+        return result;
+    }
+};
@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include "RoaringSet.h"
+#include "SetFormula.h"
+#include "FusedEvaluation.h"
+#include "ThreadPool.h"
+
+// Параллельные операции над большими множествами.
+// Блоки с разными ключами обрабатываются независимо, поэтому пространство ключей делится
+// на отрезки с примерно равным числом блоков, каждый отрезок считается в своей задаче пула,
+// а части склеиваются по порядку ключей. Небольшие операции выполняются в вызывающем потоке:
+// для них распределение по потокам обходится дороже самой работы.
+class ParallelSetOps
+{
+public:
+    // Минимальное число блоков на одну задачу
+    static const size_t BlocksPerTask = 32;
+
+private:
+    // Деление отсортированных ключей на отрезки [first, last] по BlocksPerTask и более ключей
+    static std::vector<std::pair<uint16_t, uint16_t>> keySlices(const std::vector<uint16_t>& keys, size_t workers)
+    {
+        std::vector<std::pair<uint16_t, uint16_t>> slices;
+        size_t parts = std::min(keys.size() / BlocksPerTask, workers * 4);
+        if (parts < 2) return slices;
+        for (size_t p = 0; p < parts; p++)
+        {
+            size_t begin = keys.size() * p / parts;
+            size_t end = keys.size() * (p + 1) / parts;
+            uint16_t first = p == 0 ? 0 : keys[begin];
+            uint16_t last = p + 1 == parts ? 65535 : static_cast<uint16_t>(keys[end] - 1);
+            slices.push_back({ first, last });
+        }
+        return slices;
+    }
+
+    static std::vector<uint16_t> keysOf(const RoaringSet& set)
+    {
+        std::vector<uint16_t> keys(set.containerCount());
+        for (size_t i = 0; i < keys.size(); i++) keys[i] = set.keyAt(i);
+        return keys;
+    }
+
+    static RoaringSet concatenate(std::vector<RoaringSet>& parts)
+    {
+        RoaringSet result;
+        for (RoaringSet& part : parts) result.appendAll(std::move(part));
+        return result;
+    }
+
+public:
+    static RoaringSet combine(ThreadPool& pool, const RoaringSet& a, const RoaringSet& b, SetOperation op)
+    {
+        std::vector<uint16_t> keys, left = keysOf(a), right = keysOf(b);
+        std::set_union(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(keys));
+        std::vector<std::pair<uint16_t, uint16_t>> slices = keySlices(keys, pool.size());
+        if (slices.empty()) return RoaringSet::combine(a, b, op);
+
+        std::vector<RoaringSet> parts(slices.size());
+        pool.parallelFor(slices.size(), 1, [&](size_t p)
+        {
+            parts[p] = RoaringSet::combine(a, b, op, slices[p].first, slices[p].second);
+        });
+        return concatenate(parts);
+    }
+
+    // Слитное вычисление программы формулы, разделённое по блокам результата
+    template <typename SetLookup>
+    static RoaringSet evaluate(ThreadPool& pool, const std::vector<FormulaInstruction>& program, SetLookup setAt, int universeMin, int universeMax)
+    {
+        std::vector<uint16_t> keys = FusedEvaluator::resultKeys(program, setAt, universeMin, universeMax);
+        std::vector<std::pair<uint16_t, uint16_t>> slices = keySlices(keys, pool.size());
+        if (slices.empty()) return FusedEvaluator::evaluate(program, setAt, universeMin, universeMax);
+
+        std::vector<RoaringSet> parts(slices.size());
+        pool.parallelFor(slices.size(), 1, [&](size_t p)
+        {
+            parts[p] = FusedEvaluator::evaluate(program, setAt, universeMin, universeMax, slices[p].first, slices[p].second);
+        });
+        return concatenate(parts);
+    }
+};
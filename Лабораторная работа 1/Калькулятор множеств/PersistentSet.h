@@ -0,0 +1,202 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "RoaringSet.h"
+
+// Неизменяемая (персистентная) версия множества со структурным разделением.
+// Блоки RoaringSet (ключ - старшие 16 бит) лежат в двухуровневом дереве 256 x 256:
+// корень хранит указатели на листья, лист - указатели на неизменяемые контейнеры.
+// Новая версия копирует только корень, затронутые листья и изменённые контейнеры,
+// а всё остальное разделяет с предыдущей версией. Поэтому:
+//   - снимок версии - копия одного указателя;
+//   - фиксация изменений (commit) стоит O(число блоков) сравнений указателей, изменившиеся блоки
+//     переносятся в версию без копирования; блоки, пересчитанные формулой, но совпавшие с прежними
+//     по содержимому, заменяются прежними, так что разделение сохраняется и после присваиваний;
+//   - различия двух версий (diff) обходят только листья и блоки, указатели которых различаются.
+// Рабочее множество, полученное из версии (view), ссылается на данные её контейнеров без копирования
+// (Container::borrow); блок, изменённый в рабочем множестве, переходит к собственной копии,
+// и при следующей фиксации копируется только он.
+class PersistentSet
+{
+public:
+    typedef std::shared_ptr<const Container> ChunkPtr;
+
+private:
+    static const int Fanout = 256;
+
+    struct Leaf
+    {
+        ChunkPtr chunks[Fanout];
+    };
+
+    typedef std::shared_ptr<const Leaf> LeafPtr;
+
+    struct Root
+    {
+        LeafPtr leaves[Fanout];
+        uint64_t size = 0;
+        size_t chunkCount = 0;
+    };
+
+    std::shared_ptr<const Root> root;   // nullptr - пустое множество
+
+    explicit PersistentSet(std::shared_ptr<const Root> node)
+        : root(std::move(node))
+    {
+    }
+
+    // Блок рабочего множества ссылается на данные блока версии (не изменялся после view)
+    static bool sharesData(const Container& working, const ChunkPtr& chunk)
+    {
+        return chunk && working.type() == chunk->type() && working.size() == chunk->size()
+            && working.payload() == chunk->payload();
+    }
+
+    static bool sameContents(const Container& a, const Container& b)
+    {
+        return a.size() == b.size() && a.isSubsetOf(b);
+    }
+
+    // Блок рабочего множества поверх данных неизменяемого контейнера chunk
+    static Container borrowChunk(const ChunkPtr& chunk)
+    {
+        return Container::borrow(chunk->type(), chunk->payload(), chunk->payloadCount(), chunk->size(), chunk);
+    }
+
+    // Разность блоков left \ right (отсутствующий блок - пустой)
+    static Container chunkDifference(const ChunkPtr& left, const ChunkPtr& right)
+    {
+        if (!left) return Container();
+        if (!right) return *left;
+        return Container::combine(*left, *right, SetOperation::Difference);
+    }
+
+public:
+    PersistentSet()
+    {
+    }
+
+    uint64_t size() const
+    {
+        return root ? root->size : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    size_t chunkCount() const
+    {
+        return root ? root->chunkCount : 0;
+    }
+
+    // Версии совпадают как объекты (одна получена из другой без изменений)
+    bool sameVersion(const PersistentSet& other) const
+    {
+        return root == other.root;
+    }
+
+    // Новая версия с содержимым working. Блоки working, которые ссылаются на данные previous или
+    // совпадают с ними, и листья, в которых не изменился ни один блок, берутся из previous;
+    // остальные блоки переносятся из working без копирования. working после вызова пусто
+    static PersistentSet commit(RoaringSet&& working, const PersistentSet& previous)
+    {
+        std::vector<uint16_t> keys;
+        std::vector<Container> containers;
+        working.release(keys, containers);
+
+        std::shared_ptr<Root> result = std::make_shared<Root>();
+        bool changed = false;
+        size_t c = 0;
+        for (int top = 0; top < Fanout; top++)
+        {
+            const Leaf* old = previous.root ? previous.root->leaves[top].get() : nullptr;
+            size_t begin = c;
+            while (c < keys.size() && (keys[c] >> 8) == top) c++;
+            if (begin == c && !old) continue;
+
+            // Блок берётся из previous, если рабочий блок ссылается на его данные или совпадает
+            // с ним по содержимому (результат формулы); лист - если взяты все его блоки
+            size_t oldCount = 0;
+            if (old)
+            {
+                for (int low = 0; low < Fanout; low++) oldCount += old->chunks[low] ? 1 : 0;
+            }
+            bool reused = old && oldCount == c - begin;
+            std::shared_ptr<Leaf> leaf = begin < c ? std::make_shared<Leaf>() : nullptr;
+            for (size_t i = begin; i < c; i++)
+            {
+                int low = keys[i] & 0xFF;
+                const ChunkPtr* kept = old && old->chunks[low] ? &old->chunks[low] : nullptr;
+                if (kept && (sharesData(containers[i], *kept) || sameContents(containers[i], **kept)))
+                {
+                    leaf->chunks[low] = *kept;
+                }
+                else
+                {
+                    leaf->chunks[low] = std::make_shared<const Container>(std::move(containers[i]));
+                    reused = false;
+                }
+            }
+            if (reused)
+            {
+                result->leaves[top] = previous.root->leaves[top];
+            }
+            else
+            {
+                changed = true;
+                result->leaves[top] = leaf;
+            }
+            result->chunkCount += c - begin;
+            for (size_t i = begin; i < c; i++) result->size += result->leaves[top]->chunks[keys[i] & 0xFF]->size();
+        }
+        if (!changed) return previous;
+        return PersistentSet(result->chunkCount == 0 ? nullptr : std::shared_ptr<const Root>(result));
+    }
+
+    // Рабочее множество с содержимым версии; данные блоков не копируются
+    RoaringSet view() const
+    {
+        RoaringSet result;
+        if (!root) return result;
+        for (int top = 0; top < Fanout; top++)
+        {
+            const LeafPtr& leaf = root->leaves[top];
+            if (!leaf) continue;
+            for (int low = 0; low < Fanout; low++)
+            {
+                if (leaf->chunks[low]) result.appendContainer(static_cast<uint16_t>(top << 8 | low), borrowChunk(leaf->chunks[low]));
+            }
+        }
+        return result;
+    }
+
+    // Различия версий: added = to \ from, removed = from \ to.
+    // Совпадающие листья и блоки (одни и те же указатели) пропускаются без обхода
+    static void diff(const PersistentSet& from, const PersistentSet& to, RoaringSet& added, RoaringSet& removed)
+    {
+        added.clear();
+        removed.clear();
+        if (from.root == to.root) return;
+        for (int top = 0; top < Fanout; top++)
+        {
+            const Leaf* left = from.root ? from.root->leaves[top].get() : nullptr;
+            const Leaf* right = to.root ? to.root->leaves[top].get() : nullptr;
+            if (left == right) continue;
+            for (int low = 0; low < Fanout; low++)
+            {
+                static const ChunkPtr none;
+                const ChunkPtr& before = left ? left->chunks[low] : none;
+                const ChunkPtr& after = right ? right->chunks[low] : none;
+                if (before == after) continue;
+                uint16_t key = static_cast<uint16_t>(top << 8 | low);
+                added.appendContainer(key, chunkDifference(after, before));
+                removed.appendContainer(key, chunkDifference(before, after));
+            }
+        }
+    }
+};
@@ -0,0 +1,1321 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include "BitOps.h"
+#include "FixedBitmap.h"
+#include "SortedKernels.h"
+
+// Сжатое множество целых чисел в духе Roaring bitmap.
+// 32-битное пространство значений делится на блоки по 2^16 элементов (старшие 16 бит - ключ блока),
+// и для каждого непустого блока хранится контейнер одного из трёх видов:
+//   - массив отсортированных 16-битных смещений (до 4096 элементов),
+//   - битовая карта на 65536 бит (8 КБ),
+//   - список отрезков [start, last] для плотных участков.
+// Пустые блоки не хранятся, поэтому память растёт с плотностью множества, а не с размером универсума.
+
+// Бинарные операции над множествами
+enum class SetOperation
+{
+    Union,
+    Intersection,
+    Difference,
+    SymmetricDifference
+};
+
+// Значение операции для элемента, входящего (или нет) в левый и правый операнды
+inline bool applyOperation(SetOperation op, bool inLeft, bool inRight)
+{
+    switch (op)
+    {
+    case SetOperation::Union: return inLeft || inRight;
+    case SetOperation::Intersection: return inLeft && inRight;
+    case SetOperation::Difference: return inLeft && !inRight;
+    case SetOperation::SymmetricDifference: return inLeft != inRight;
+    }
+    return false;
+}
+
+// Операция над операндами, каждый из которых может быть дополнением (!A или A, !B или B),
+// сводится к одной операции над самими A и B (swapped - операнды переставлены) и,
+// возможно, дополнению её результата:
+//   A*!B = A-B,  !A*B = B-A,  !A*!B = !(A+B),   A+!B = !(B-A),  !A+B = !(A-B),  !A+!B = !(A*B),
+//   A-!B = A*B,  !A-B = !(A+B), !A-!B = B-A,    A^!B = !A^B = !(A^B),  !A^!B = A^B
+// Тождества верны, когда все операнды лежат в универсуме, относительно которого берутся дополнения.
+struct ComplementedOperation
+{
+    SetOperation op;
+    bool swapped;
+    bool negated;
+};
+
+inline ComplementedOperation withComplements(SetOperation op, bool leftNegated, bool rightNegated)
+{
+    if (!leftNegated && !rightNegated) return { op, false, false };
+    switch (op)
+    {
+    case SetOperation::Union:
+        if (leftNegated && rightNegated) return { SetOperation::Intersection, false, true };
+        return { SetOperation::Difference, rightNegated, true };
+    case SetOperation::Intersection:
+        if (leftNegated && rightNegated) return { SetOperation::Union, false, true };
+        return { SetOperation::Difference, leftNegated, false };
+    case SetOperation::Difference:
+        if (leftNegated && rightNegated) return { SetOperation::Difference, true, false };
+        if (leftNegated) return { SetOperation::Union, false, true };
+        return { SetOperation::Intersection, false, false };
+    case SetOperation::SymmetricDifference:
+        return { SetOperation::SymmetricDifference, false, leftNegated != rightNegated };
+    }
+    return { op, false, false };
+}
+
+// Операция над отсортированными массивами; out должен вмещать sortedResultCapacity элементов
+template <typename T>
+inline size_t combineSorted(const T* a, size_t aSize, const T* b, size_t bSize, T* out, SetOperation op)
+{
+    switch (op)
+    {
+    case SetOperation::Union: return unionSorted(a, aSize, b, bSize, out);
+    case SetOperation::Intersection: return intersectSorted(a, aSize, b, bSize, out);
+    case SetOperation::Difference: return differenceSorted(a, aSize, b, bSize, out);
+    case SetOperation::SymmetricDifference: return symmetricDifferenceSorted(a, aSize, b, bSize, out);
+    }
+    return 0;
+}
+
+inline size_t sortedResultCapacity(size_t aSize, size_t bSize, SetOperation op)
+{
+    switch (op)
+    {
+    case SetOperation::Intersection: return std::min(aSize, bSize);
+    case SetOperation::Difference: return aSize;
+    default: return aSize + bSize;
+    }
+}
+
+// Отрезок подряд идущих элементов внутри блока (границы включительно)
+struct Run
+{
+    uint16_t start;
+    uint16_t last;
+};
+
+enum class ContainerType : uint8_t
+{
+    Array,
+    Bitmap,
+    Run
+};
+
+// Контейнер одного блока из 2^16 элементов
+class Container
+{
+public:
+    typedef FixedBitmap<65536> ChunkBitmap;
+
+    // Максимальная мощность контейнера-массива: дальше битовая карта компактнее
+    static const int ArrayLimit = 4096;
+
+private:
+    ContainerType kind;
+    int cardinality;
+    std::vector<uint16_t> values;          // Array
+    std::unique_ptr<ChunkBitmap> bitmap;   // Bitmap
+    std::vector<Run> runs;                 // Run
+
+    // Данные, которыми контейнер не владеет (страницы отображённого в память снимка, см. SetSnapshot.h):
+    // external указывает на массив, битовую карту или отрезки в зависимости от kind,
+    // externalCount - число значений или отрезков, externalOwner удерживает память, пока жив контейнер
+    const void* external;
+    int externalCount;
+    std::shared_ptr<const void> externalOwner;
+
+    // Текущее представление независимо от того, где лежат данные
+    const uint16_t* arrayData() const
+    {
+        return external ? static_cast<const uint16_t*>(external) : values.data();
+    }
+
+    size_t arraySize() const
+    {
+        return external ? static_cast<size_t>(externalCount) : values.size();
+    }
+
+    const ChunkBitmap& bits() const
+    {
+        return external ? *static_cast<const ChunkBitmap*>(external) : *bitmap;
+    }
+
+    const Run* runData() const
+    {
+        return external ? static_cast<const Run*>(external) : runs.data();
+    }
+
+    size_t runSize() const
+    {
+        return external ? static_cast<size_t>(externalCount) : runs.size();
+    }
+
+    void dropExternal()
+    {
+        external = nullptr;
+        externalCount = 0;
+        externalOwner.reset();
+    }
+
+    static std::unique_ptr<ChunkBitmap> newBitmap()
+    {
+        return std::unique_ptr<ChunkBitmap>(new ChunkBitmap());
+    }
+
+    static int runsCardinality(const Run* runList, size_t count)
+    {
+        int total = 0;
+        for (size_t r = 0; r < count; r++) total += runList[r].last - runList[r].start + 1;
+        return total;
+    }
+
+    // Количество отрезков в текущем представлении
+    int countRuns() const
+    {
+        switch (kind)
+        {
+        case ContainerType::Array:
+        {
+            const uint16_t* data = arrayData();
+            int result = 0;
+            for (size_t i = 0; i < arraySize(); i++)
+            {
+                if (i == 0 || data[i] != data[i - 1] + 1) result++;
+            }
+            return result;
+        }
+        case ContainerType::Bitmap:
+        {
+            // Начало отрезка - установленный бит, перед которым стоит ноль
+            const ChunkBitmap& words = bits();
+            int result = 0;
+            uint64_t carry = 0;
+            for (int w = 0; w < ChunkBitmap::WordCount; w++)
+            {
+                uint64_t word = words.word(w);
+                result += bitCount(word & ~((word << 1) | carry));
+                carry = word >> 63;
+            }
+            return result;
+        }
+        case ContainerType::Run:
+            return static_cast<int>(runSize());
+        }
+        return 0;
+    }
+
+    std::vector<uint16_t> toArrayValues() const
+    {
+        std::vector<uint16_t> result;
+        result.reserve(cardinality);
+        forEach([&](uint16_t low) { result.push_back(low); });
+        return result;
+    }
+
+    std::unique_ptr<ChunkBitmap> toBitmapWords() const
+    {
+        std::unique_ptr<ChunkBitmap> result = newBitmap();
+        switch (kind)
+        {
+        case ContainerType::Array:
+            for (size_t i = 0; i < arraySize(); i++) result->set(arrayData()[i]);
+            break;
+        case ContainerType::Bitmap:
+            *result = bits();
+            break;
+        case ContainerType::Run:
+            for (size_t r = 0; r < runSize(); r++) result->setRange(runData()[r].start, runData()[r].last);
+            break;
+        }
+        return result;
+    }
+
+    std::vector<Run> toRunList() const
+    {
+        std::vector<Run> result;
+        if (kind == ContainerType::Run) return std::vector<Run>(runData(), runData() + runSize());
+        if (kind == ContainerType::Array)
+        {
+            for (size_t i = 0; i < arraySize(); i++)
+            {
+                uint16_t low = arrayData()[i];
+                if (!result.empty() && result.back().last + 1 == low) result.back().last = low;
+                else result.push_back({ low, low });
+            }
+            return result;
+        }
+
+        // Поиск отрезков в битовой карте: заполняем младшие нули единицами и ищем первый ноль
+        const ChunkBitmap& words = bits();
+        int w = 0;
+        uint64_t current = words.word(0);
+        const int lastWord = ChunkBitmap::WordCount - 1;
+        while (true)
+        {
+            while (current == 0 && w < lastWord) current = words.word(++w);
+            if (current == 0) break;
+            int start = w * 64 + lowestBit(current);
+            current |= current - 1;
+            while (current == ~0ULL && w < lastWord) current = words.word(++w);
+            if (current == ~0ULL)
+            {
+                result.push_back({ static_cast<uint16_t>(start), 65535 });
+                break;
+            }
+            int end = w * 64 + lowestBit(~current);
+            result.push_back({ static_cast<uint16_t>(start), static_cast<uint16_t>(end - 1) });
+            current &= current + 1;
+        }
+        return result;
+    }
+
+    // Слияние двух отсортированных массивов ядрами SortedKernels.h
+    static Container arrayArray(const uint16_t* a, size_t na, const uint16_t* b, size_t nb, SetOperation op)
+    {
+        std::vector<uint16_t> result(sortedResultCapacity(na, nb, op));
+        size_t count = combineSorted(a, na, b, nb, result.data(), op);
+        result.resize(count);
+        return fromArray(std::move(result));
+    }
+
+    static Container bitmapBitmap(const ChunkBitmap& a, const ChunkBitmap& b, SetOperation op)
+    {
+        std::unique_ptr<ChunkBitmap> result = newBitmap();
+        *result = a;
+        switch (op)
+        {
+        case SetOperation::Union: *result |= b; break;
+        case SetOperation::Intersection: *result &= b; break;
+        case SetOperation::Difference: result->andNot(b); break;
+        case SetOperation::SymmetricDifference: *result ^= b; break;
+        }
+        return fromBitmap(std::move(result));
+    }
+
+    // Массив и битовая карта; arrayOnLeft задаёт порядок операндов для разности
+    static Container arrayBitmap(const uint16_t* array, size_t count, const ChunkBitmap& words, SetOperation op, bool arrayOnLeft)
+    {
+        bool filterArray = op == SetOperation::Intersection || (op == SetOperation::Difference && arrayOnLeft);
+        if (filterArray)
+        {
+            // Результат - подмножество массива: проверяем каждый элемент по битовой карте
+            bool keepIfPresent = op == SetOperation::Intersection;
+            std::vector<uint16_t> result;
+            result.reserve(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                if (words.test(array[i]) == keepIfPresent) result.push_back(array[i]);
+            }
+            return fromArray(std::move(result));
+        }
+
+        // Иначе изменяем копию битовой карты по элементам массива
+        std::unique_ptr<ChunkBitmap> result = newBitmap();
+        *result = words;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint16_t low = array[i];
+            switch (op)
+            {
+            case SetOperation::Union: result->set(low); break;
+            case SetOperation::Difference: result->reset(low); break;
+            case SetOperation::SymmetricDifference: result->word(low >> 6) ^= 1ULL << (low & 63); break;
+            default: break;
+            }
+        }
+        return fromBitmap(std::move(result));
+    }
+
+    // Проход по границам отрезков обоих операндов; 65536 используется как конец блока
+    static std::vector<Run> combineRuns(const Run* a, size_t na, const Run* b, size_t nb, SetOperation op)
+    {
+        std::vector<Run> result;
+        size_t i = 0, j = 0;
+        uint32_t position = 0;
+        while (position < 65536 && (i < na || j < nb))
+        {
+            bool inA = i < na && a[i].start <= position;
+            bool inB = j < nb && b[j].start <= position;
+            uint32_t nextA = inA ? a[i].last + 1u : (i < na ? a[i].start : 65536u);
+            uint32_t nextB = inB ? b[j].last + 1u : (j < nb ? b[j].start : 65536u);
+            uint32_t next = std::min(nextA, nextB);
+
+            if (applyOperation(op, inA, inB))
+            {
+                if (!result.empty() && result.back().last + 1u == position) result.back().last = static_cast<uint16_t>(next - 1);
+                else result.push_back({ static_cast<uint16_t>(position), static_cast<uint16_t>(next - 1) });
+            }
+
+            position = next;
+            if (i < na && a[i].last < position) i++;
+            if (j < nb && b[j].last < position) j++;
+        }
+        return result;
+    }
+
+    // Пересечение массива с отрезками или разность "массив минус отрезки" двумя указателями
+    static Container filterArrayByRuns(const uint16_t* array, size_t count, const Run* runList, size_t runCount, bool keepIfPresent)
+    {
+        std::vector<uint16_t> result;
+        result.reserve(count);
+        size_t r = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint16_t low = array[i];
+            while (r < runCount && runList[r].last < low) r++;
+            bool present = r < runCount && runList[r].start <= low;
+            if (present == keepIfPresent) result.push_back(low);
+        }
+        return fromArray(std::move(result));
+    }
+
+public:
+    Container() : kind(ContainerType::Array), cardinality(0), external(nullptr), externalCount(0)
+    {
+    }
+
+    // Копия контейнера поверх чужих данных ссылается на те же данные
+    Container(const Container& other)
+        : kind(other.kind), cardinality(other.cardinality), values(other.values), runs(other.runs),
+          external(other.external), externalCount(other.externalCount), externalOwner(other.externalOwner)
+    {
+        if (other.bitmap) bitmap.reset(new ChunkBitmap(*other.bitmap));
+    }
+
+    Container(Container&& other) = default;
+
+    Container& operator=(const Container& other)
+    {
+        if (this != &other)
+        {
+            Container copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    Container& operator=(Container&& other) = default;
+
+    static Container fromArray(std::vector<uint16_t>&& sortedValues)
+    {
+        Container result;
+        result.kind = ContainerType::Array;
+        result.cardinality = static_cast<int>(sortedValues.size());
+        result.values = std::move(sortedValues);
+        return result;
+    }
+
+    static Container fromBitmap(std::unique_ptr<ChunkBitmap>&& bits)
+    {
+        Container result;
+        result.kind = ContainerType::Bitmap;
+        result.cardinality = bits->count();
+        result.bitmap = std::move(bits);
+        return result;
+    }
+
+    static Container fromRuns(std::vector<Run>&& runList)
+    {
+        Container result;
+        result.kind = ContainerType::Run;
+        result.cardinality = runsCardinality(runList.data(), runList.size());
+        result.runs = std::move(runList);
+        return result;
+    }
+
+    // Контейнер поверх чужих данных без копирования: data - count значений массива, битовая карта
+    // или count отрезков в зависимости от type. owner удерживает память, пока живы контейнер и его копии;
+    // при изменении контейнер переходит к собственной копии данных
+    static Container borrow(ContainerType type, const void* data, int count, int size, std::shared_ptr<const void> owner)
+    {
+        Container result;
+        result.kind = type;
+        result.cardinality = size;
+        result.external = data;
+        result.externalCount = count;
+        result.externalOwner = std::move(owner);
+        return result;
+    }
+
+    // Данные текущего представления одним непрерывным куском (для записи снимка);
+    // payloadCount - число значений массива или отрезков, для битовой карты - число слов
+    const void* payload() const
+    {
+        switch (kind)
+        {
+        case ContainerType::Array: return arrayData();
+        case ContainerType::Bitmap: return &bits();
+        case ContainerType::Run: return runData();
+        }
+        return nullptr;
+    }
+
+    size_t payloadBytes() const
+    {
+        switch (kind)
+        {
+        case ContainerType::Array: return arraySize() * sizeof(uint16_t);
+        case ContainerType::Bitmap: return sizeof(ChunkBitmap);
+        case ContainerType::Run: return runSize() * sizeof(Run);
+        }
+        return 0;
+    }
+
+    int payloadCount() const
+    {
+        switch (kind)
+        {
+        case ContainerType::Array: return static_cast<int>(arraySize());
+        case ContainerType::Bitmap: return ChunkBitmap::WordCount;
+        case ContainerType::Run: return static_cast<int>(runSize());
+        }
+        return 0;
+    }
+
+    // Блок, заполненный элементами отрезка [first, last]
+    static Container full(uint16_t first, uint16_t last)
+    {
+        std::vector<Run> runList(1, Run{ first, last });
+        return fromRuns(std::move(runList));
+    }
+
+    ContainerType type() const
+    {
+        return kind;
+    }
+
+    int size() const
+    {
+        return cardinality;
+    }
+
+    bool empty() const
+    {
+        return cardinality == 0;
+    }
+
+    // Приблизительный объём памяти под собственные данные контейнера (чужие данные не учитываются)
+    size_t memoryBytes() const
+    {
+        return values.capacity() * sizeof(uint16_t) + (bitmap ? sizeof(ChunkBitmap) : 0) + runs.capacity() * sizeof(Run);
+    }
+
+    bool contains(uint16_t low) const
+    {
+        switch (kind)
+        {
+        case ContainerType::Array:
+            return std::binary_search(arrayData(), arrayData() + arraySize(), low);
+        case ContainerType::Bitmap:
+            return bits().test(low);
+        case ContainerType::Run:
+        {
+            const Run* it = std::upper_bound(runData(), runData() + runSize(), low,
+                [](uint16_t value, const Run& run) { return value < run.start; });
+            return it != runData() && (it - 1)->last >= low;
+        }
+        }
+        return false;
+    }
+
+    void add(uint16_t low)
+    {
+        if (contains(low)) return;
+        if (external)
+        {
+            // Чужие данные только для чтения: сначала собственная копия
+            if (kind == ContainerType::Array) values.assign(arrayData(), arrayData() + arraySize());
+            else if (kind == ContainerType::Bitmap) bitmap = toBitmapWords();
+            else runs = toRunList();
+            dropExternal();
+        }
+        if (kind == ContainerType::Run)
+        {
+            // Отрезки перестраиваются при optimize(); для вставки переходим к массиву или карте
+            if (cardinality < ArrayLimit) values = toArrayValues();
+            else bitmap = toBitmapWords();
+            kind = cardinality < ArrayLimit ? ContainerType::Array : ContainerType::Bitmap;
+            runs.clear();
+        }
+        if (kind == ContainerType::Array)
+        {
+            values.insert(std::lower_bound(values.begin(), values.end(), low), low);
+            cardinality++;
+            if (cardinality > ArrayLimit)
+            {
+                bitmap = toBitmapWords();
+                std::vector<uint16_t>().swap(values);
+                kind = ContainerType::Bitmap;
+            }
+            return;
+        }
+        bitmap->set(low);
+        cardinality++;
+    }
+
+    // Выбор самого компактного представления для текущего содержимого
+    void optimize()
+    {
+        int runCount = countRuns();
+        size_t runBytes = runCount * sizeof(Run);
+        size_t arrayBytes = cardinality <= ArrayLimit ? cardinality * sizeof(uint16_t) : sizeof(ChunkBitmap);
+        size_t bestOther = std::min(arrayBytes, sizeof(ChunkBitmap));
+
+        ContainerType target;
+        if (runBytes < bestOther) target = ContainerType::Run;
+        else if (cardinality <= ArrayLimit) target = ContainerType::Array;
+        else target = ContainerType::Bitmap;
+
+        if (target == kind) return;
+        switch (target)
+        {
+        case ContainerType::Array:
+            values = toArrayValues();
+            break;
+        case ContainerType::Bitmap:
+            bitmap = toBitmapWords();
+            break;
+        case ContainerType::Run:
+            runs = toRunList();
+            break;
+        }
+        if (target != ContainerType::Array) std::vector<uint16_t>().swap(values);
+        if (target != ContainerType::Bitmap) bitmap.reset();
+        if (target != ContainerType::Run) std::vector<Run>().swap(runs);
+        dropExternal();
+        kind = target;
+    }
+
+    // Наименьший и наибольший элементы непустого контейнера
+    uint16_t first() const
+    {
+        switch (kind)
+        {
+        case ContainerType::Array:
+            return arrayData()[0];
+        case ContainerType::Bitmap:
+        {
+            const ChunkBitmap& words = bits();
+            int w = 0;
+            while (words.word(w) == 0) w++;
+            return static_cast<uint16_t>(w * 64 + lowestBit(words.word(w)));
+        }
+        case ContainerType::Run:
+            return runData()[0].start;
+        }
+        return 0;
+    }
+
+    uint16_t last() const
+    {
+        switch (kind)
+        {
+        case ContainerType::Array:
+            return arrayData()[arraySize() - 1];
+        case ContainerType::Bitmap:
+        {
+            const ChunkBitmap& words = bits();
+            int w = ChunkBitmap::WordCount - 1;
+            while (words.word(w) == 0) w--;
+            return static_cast<uint16_t>(w * 64 + highestBit(words.word(w)));
+        }
+        case ContainerType::Run:
+            return runData()[runSize() - 1].last;
+        }
+        return 0;
+    }
+
+    // Обход элементов блока по возрастанию
+    template <typename Func>
+    void forEach(Func func) const
+    {
+        switch (kind)
+        {
+        case ContainerType::Array:
+        {
+            const uint16_t* data = arrayData();
+            for (size_t i = 0, count = arraySize(); i < count; i++) func(data[i]);
+            break;
+        }
+        case ContainerType::Bitmap:
+            bits().forEach([&](int bit) { func(static_cast<uint16_t>(bit)); });
+            break;
+        case ContainerType::Run:
+        {
+            const Run* runList = runData();
+            for (size_t r = 0, count = runSize(); r < count; r++)
+            {
+                for (uint32_t low = runList[r].start; low <= runList[r].last; low++) func(static_cast<uint16_t>(low));
+            }
+            break;
+        }
+        }
+    }
+
+    // Запись слов [firstWord, firstWord + wordCount) блока в out.
+    // cursor хранит позицию в массиве или списке отрезков между последовательными вызовами по возрастанию слов.
+    void loadWords(int firstWord, int wordCount, uint64_t* out, size_t& cursor) const
+    {
+        if (kind == ContainerType::Bitmap)
+        {
+            const ChunkBitmap& words = bits();
+            for (int w = 0; w < wordCount; w++) out[w] = words.word(firstWord + w);
+            return;
+        }
+
+        for (int w = 0; w < wordCount; w++) out[w] = 0;
+        uint32_t blockStart = static_cast<uint32_t>(firstWord) * 64;
+        uint32_t blockEnd = blockStart + static_cast<uint32_t>(wordCount) * 64;
+        if (kind == ContainerType::Array)
+        {
+            const uint16_t* data = arrayData();
+            size_t count = arraySize();
+            while (cursor < count && data[cursor] < blockEnd)
+            {
+                uint32_t bit = data[cursor] - blockStart;
+                out[bit >> 6] |= 1ULL << (bit & 63);
+                cursor++;
+            }
+            return;
+        }
+
+        const Run* runList = runData();
+        size_t runCount = runSize();
+        while (cursor < runCount && runList[cursor].start < blockEnd)
+        {
+            uint32_t first = std::max<uint32_t>(runList[cursor].start, blockStart) - blockStart;
+            uint32_t last = std::min<uint32_t>(runList[cursor].last, blockEnd - 1) - blockStart;
+            for (uint32_t w = first >> 6; w <= (last >> 6); w++)
+            {
+                uint64_t mask = ~0ULL;
+                if (w == (first >> 6)) mask &= ~0ULL << (first & 63);
+                if (w == (last >> 6)) mask &= lowMask(static_cast<int>(last & 63) + 1);
+                out[w] |= mask;
+            }
+            if (runList[cursor].last >= blockEnd) break;
+            cursor++;
+        }
+    }
+
+    // Контейнер из 1024 слов битовой карты с известной мощностью
+    static Container fromWords(const uint64_t* words, int count)
+    {
+        Container result;
+        if (count <= ArrayLimit)
+        {
+            std::vector<uint16_t> found;
+            found.reserve(count);
+            for (int w = 0; w < ChunkBitmap::WordCount; w++)
+            {
+                uint64_t bits = words[w];
+                while (bits != 0)
+                {
+                    found.push_back(static_cast<uint16_t>(w * 64 + lowestBit(bits)));
+                    bits &= bits - 1;
+                }
+            }
+            result = fromArray(std::move(found));
+        }
+        else
+        {
+            std::unique_ptr<ChunkBitmap> bits = newBitmap();
+            for (int w = 0; w < ChunkBitmap::WordCount; w++) bits->word(w) = words[w];
+            result = fromBitmap(std::move(bits));
+        }
+        result.optimize();
+        return result;
+    }
+
+    // Бинарная операция с выбором ядра по паре видов контейнеров
+    static Container combine(const Container& a, const Container& b, SetOperation op)
+    {
+        Container result;
+        ContainerType ta = a.kind, tb = b.kind;
+
+        if (ta == ContainerType::Array && tb == ContainerType::Array)
+        {
+            result = arrayArray(a.arrayData(), a.arraySize(), b.arrayData(), b.arraySize(), op);
+        }
+        else if (ta == ContainerType::Bitmap && tb == ContainerType::Bitmap)
+        {
+            result = bitmapBitmap(a.bits(), b.bits(), op);
+        }
+        else if (ta == ContainerType::Run && tb == ContainerType::Run)
+        {
+            result = fromRuns(combineRuns(a.runData(), a.runSize(), b.runData(), b.runSize(), op));
+        }
+        else if (ta == ContainerType::Array && tb == ContainerType::Bitmap)
+        {
+            result = arrayBitmap(a.arrayData(), a.arraySize(), b.bits(), op, true);
+        }
+        else if (ta == ContainerType::Bitmap && tb == ContainerType::Array)
+        {
+            result = arrayBitmap(b.arrayData(), b.arraySize(), a.bits(), op, false);
+        }
+        else if (ta == ContainerType::Array && tb == ContainerType::Run && op == SetOperation::Intersection)
+        {
+            result = filterArrayByRuns(a.arrayData(), a.arraySize(), b.runData(), b.runSize(), true);
+        }
+        else if (ta == ContainerType::Run && tb == ContainerType::Array && op == SetOperation::Intersection)
+        {
+            result = filterArrayByRuns(b.arrayData(), b.arraySize(), a.runData(), a.runSize(), true);
+        }
+        else if (ta == ContainerType::Array && tb == ContainerType::Run && op == SetOperation::Difference)
+        {
+            result = filterArrayByRuns(a.arrayData(), a.arraySize(), b.runData(), b.runSize(), false);
+        }
+        else if (ta == ContainerType::Bitmap || tb == ContainerType::Bitmap)
+        {
+            // Отрезки и битовая карта: отрезки раскладываются в карту заливкой слов
+            std::unique_ptr<ChunkBitmap> left = a.kind == ContainerType::Bitmap ? nullptr : a.toBitmapWords();
+            std::unique_ptr<ChunkBitmap> right = b.kind == ContainerType::Bitmap ? nullptr : b.toBitmapWords();
+            result = bitmapBitmap(left ? *left : a.bits(), right ? *right : b.bits(), op);
+        }
+        else
+        {
+            // Отрезки и массив: массив переводится в отрезки, дальше общий проход по границам
+            std::vector<Run> left = a.toRunList(), right = b.toRunList();
+            result = fromRuns(combineRuns(left.data(), left.size(), right.data(), right.size(), op));
+        }
+
+        result.optimize();
+        return result;
+    }
+
+    // Мощность пересечения без построения результата: слияние с подсчётом для массивов,
+    // popcount для битовых карт, сумма перекрытий для отрезков
+    static int intersectionSize(const Container& a, const Container& b)
+    {
+        ContainerType ta = a.kind, tb = b.kind;
+        if (ta == ContainerType::Array && tb == ContainerType::Array)
+        {
+            return static_cast<int>(intersectionCountSorted(a.arrayData(), a.arraySize(), b.arrayData(), b.arraySize()));
+        }
+        if (ta == ContainerType::Bitmap && tb == ContainerType::Bitmap)
+        {
+            const ChunkBitmap& left = a.bits();
+            const ChunkBitmap& right = b.bits();
+            int total = 0;
+            for (int w = 0; w < ChunkBitmap::WordCount; w++) total += bitCount(left.word(w) & right.word(w));
+            return total;
+        }
+        if (ta == ContainerType::Array || tb == ContainerType::Array)
+        {
+            // Массив проверяется поэлементно по второму контейнеру
+            const Container& array = ta == ContainerType::Array ? a : b;
+            const Container& other = ta == ContainerType::Array ? b : a;
+            const uint16_t* data = array.arrayData();
+            size_t count = array.arraySize();
+            int total = 0;
+            if (other.kind == ContainerType::Bitmap)
+            {
+                const ChunkBitmap& words = other.bits();
+                for (size_t i = 0; i < count; i++) total += words.test(data[i]);
+                return total;
+            }
+            const Run* runList = other.runData();
+            size_t runCount = other.runSize();
+            size_t r = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                while (r < runCount && runList[r].last < data[i]) r++;
+                total += r < runCount && runList[r].start <= data[i];
+            }
+            return total;
+        }
+        if (ta == ContainerType::Run && tb == ContainerType::Run)
+        {
+            const Run* left = a.runData();
+            const Run* right = b.runData();
+            size_t na = a.runSize(), nb = b.runSize();
+            int total = 0;
+            size_t i = 0, j = 0;
+            while (i < na && j < nb)
+            {
+                int start = std::max(left[i].start, right[j].start);
+                int last = std::min(left[i].last, right[j].last);
+                if (start <= last) total += last - start + 1;
+                if (left[i].last < right[j].last) i++;
+                else j++;
+            }
+            return total;
+        }
+        // Битовая карта и отрезки: popcount слов внутри каждого отрезка
+        const Container& runOwner = ta == ContainerType::Run ? a : b;
+        const ChunkBitmap& words = ta == ContainerType::Bitmap ? a.bits() : b.bits();
+        const Run* runList = runOwner.runData();
+        int total = 0;
+        for (size_t r = 0; r < runOwner.runSize(); r++) total += words.countRange(runList[r].start, runList[r].last);
+        return total;
+    }
+
+    // Есть ли общий элемент; проход прекращается на первом совпадении
+    static bool intersects(const Container& a, const Container& b)
+    {
+        ContainerType ta = a.kind, tb = b.kind;
+        if (ta == ContainerType::Array && tb == ContainerType::Array)
+        {
+            return intersectsSorted(a.arrayData(), a.arraySize(), b.arrayData(), b.arraySize());
+        }
+        if (ta == ContainerType::Bitmap && tb == ContainerType::Bitmap)
+        {
+            const ChunkBitmap& left = a.bits();
+            const ChunkBitmap& right = b.bits();
+            for (int w = 0; w < ChunkBitmap::WordCount; w++)
+            {
+                if ((left.word(w) & right.word(w)) != 0) return true;
+            }
+            return false;
+        }
+        if (ta == ContainerType::Array || tb == ContainerType::Array)
+        {
+            const Container& array = ta == ContainerType::Array ? a : b;
+            const Container& other = ta == ContainerType::Array ? b : a;
+            for (size_t i = 0; i < array.arraySize(); i++)
+            {
+                if (other.contains(array.arrayData()[i])) return true;
+            }
+            return false;
+        }
+        return intersectionSize(a, b) > 0;
+    }
+
+    // Все элементы этого контейнера есть в other; проход прекращается на первом контрпримере
+    bool isSubsetOf(const Container& other) const
+    {
+        if (cardinality > other.cardinality) return false;
+        if (kind == ContainerType::Array && other.kind == ContainerType::Array)
+        {
+            return isSubsetSorted(arrayData(), arraySize(), other.arrayData(), other.arraySize());
+        }
+        if (kind == ContainerType::Array)
+        {
+            for (size_t i = 0; i < arraySize(); i++)
+            {
+                if (!other.contains(arrayData()[i])) return false;
+            }
+            return true;
+        }
+        if (kind == ContainerType::Bitmap && other.kind == ContainerType::Bitmap)
+        {
+            const ChunkBitmap& left = bits();
+            const ChunkBitmap& right = other.bits();
+            for (int w = 0; w < ChunkBitmap::WordCount; w++)
+            {
+                if ((left.word(w) & ~right.word(w)) != 0) return false;
+            }
+            return true;
+        }
+        return intersectionSize(*this, other) == cardinality;
+    }
+
+    // Дополнение внутри отрезка блока [first, last]
+    Container complement(uint16_t first, uint16_t last) const
+    {
+        Container result;
+        if (kind == ContainerType::Bitmap)
+        {
+            std::unique_ptr<ChunkBitmap> range = newBitmap();
+            range->setRange(first, last);
+            range->andNot(bits());
+            result = fromBitmap(std::move(range));
+        }
+        else
+        {
+            Run whole = { first, last };
+            std::vector<Run> present = toRunList();
+            result = fromRuns(combineRuns(&whole, 1, present.data(), present.size(), SetOperation::Difference));
+        }
+        result.optimize();
+        return result;
+    }
+};
+
+// Множество целых чисел из сжатых блоков
+class RoaringSet
+{
+private:
+    std::vector<uint16_t> keys;            // Отсортированные ключи непустых блоков
+    std::vector<Container> containers;     // Контейнеры в порядке ключей
+
+    // Индекс блока с ключом key или -1
+    int findKey(uint16_t key) const
+    {
+        auto it = std::lower_bound(keys.begin(), keys.end(), key);
+        if (it == keys.end() || *it != key) return -1;
+        return static_cast<int>(it - keys.begin());
+    }
+
+public:
+    // Сдвиг знакового значения в беззнаковое с сохранением порядка
+    static uint32_t toUnsigned(int value)
+    {
+        return static_cast<uint32_t>(value) ^ 0x80000000u;
+    }
+
+    static int toSigned(uint32_t value)
+    {
+        return static_cast<int>(value ^ 0x80000000u);
+    }
+
+    // Добавление блока в конец; ключи должны поступать по возрастанию, пустые блоки пропускаются
+    void appendContainer(uint16_t key, Container&& container)
+    {
+        if (container.empty()) return;
+        keys.push_back(key);
+        containers.push_back(std::move(container));
+    }
+
+    uint16_t keyAt(size_t index) const
+    {
+        return keys[index];
+    }
+
+    const Container& containerAt(size_t index) const
+    {
+        return containers[index];
+    }
+
+    // Контейнер блока с ключом key или nullptr
+    const Container* findContainer(uint16_t key) const
+    {
+        int index = findKey(key);
+        return index >= 0 ? &containers[index] : nullptr;
+    }
+
+    void clear()
+    {
+        keys.clear();
+        containers.clear();
+    }
+
+    // Передача ключей и контейнеров без копирования; множество становится пустым
+    void release(std::vector<uint16_t>& keyList, std::vector<Container>& containerList)
+    {
+        keyList = std::move(keys);
+        containerList = std::move(containers);
+        clear();
+    }
+
+    bool empty() const
+    {
+        return keys.empty();
+    }
+
+    // Мощность множества (может превышать 2^31)
+    uint64_t size() const
+    {
+        uint64_t total = 0;
+        for (const Container& container : containers) total += container.size();
+        return total;
+    }
+
+    size_t containerCount() const
+    {
+        return containers.size();
+    }
+
+    size_t memoryBytes() const
+    {
+        size_t total = keys.capacity() * sizeof(uint16_t) + containers.capacity() * sizeof(Container);
+        for (const Container& container : containers) total += container.memoryBytes();
+        return total;
+    }
+
+    bool contains(int value) const
+    {
+        uint32_t u = toUnsigned(value);
+        int index = findKey(static_cast<uint16_t>(u >> 16));
+        return index >= 0 && containers[index].contains(static_cast<uint16_t>(u & 0xFFFF));
+    }
+
+    void add(int value)
+    {
+        uint32_t u = toUnsigned(value);
+        uint16_t key = static_cast<uint16_t>(u >> 16);
+        auto it = std::lower_bound(keys.begin(), keys.end(), key);
+        size_t index = it - keys.begin();
+        if (it == keys.end() || *it != key)
+        {
+            keys.insert(it, key);
+            containers.insert(containers.begin() + index, Container());
+        }
+        containers[index].add(static_cast<uint16_t>(u & 0xFFFF));
+    }
+
+    // Добавление всех чисел отрезка [first, last]
+    void addRange(int first, int last)
+    {
+        if (first > last) return;
+        uint32_t from = toUnsigned(first), to = toUnsigned(last);
+        RoaringSet range;
+        for (uint32_t key = from >> 16; key <= (to >> 16); key++)
+        {
+            uint16_t low = key == (from >> 16) ? static_cast<uint16_t>(from & 0xFFFF) : 0;
+            uint16_t high = key == (to >> 16) ? static_cast<uint16_t>(to & 0xFFFF) : 65535;
+            range.appendContainer(static_cast<uint16_t>(key), Container::full(low, high));
+        }
+        *this = combine(*this, range, SetOperation::Union);
+    }
+
+    // Множество из отрезков [first, last], заданных в любом порядке (отрезки могут пересекаться
+    // и повторяться): отрезки сортируются и сливаются, затем блоки строятся за один проход.
+    // В отличие от addRange для каждого отрезка, время не зависит от размера уже собранного множества
+    static RoaringSet fromRanges(std::vector<std::pair<int, int>> ranges)
+    {
+        std::sort(ranges.begin(), ranges.end());
+        RoaringSet result;
+        uint32_t key = 0;
+        std::vector<Run> chunkRuns;
+        auto flush = [&]()
+        {
+            if (chunkRuns.empty()) return;
+            Container container = Container::fromRuns(std::move(chunkRuns));
+            container.optimize();
+            result.appendContainer(static_cast<uint16_t>(key), std::move(container));
+            chunkRuns.clear();
+        };
+        // Слитый отрезок [low, high] раскладывается по блокам
+        auto emit = [&](uint32_t low, uint32_t high)
+        {
+            while (true)
+            {
+                uint32_t lowKey = low >> 16;
+                uint32_t chunkEnd = std::min(high, (lowKey << 16) | 0xFFFF);
+                if (lowKey != key) flush();
+                key = lowKey;
+                chunkRuns.push_back(Run{ static_cast<uint16_t>(low & 0xFFFF), static_cast<uint16_t>(chunkEnd & 0xFFFF) });
+                if (chunkEnd == high) break;
+                low = chunkEnd + 1;
+            }
+        };
+        bool pending = false;
+        uint32_t low = 0, high = 0;
+        for (const auto& range : ranges)
+        {
+            if (range.first > range.second) continue;
+            uint32_t from = toUnsigned(range.first), to = toUnsigned(range.second);
+            if (pending && (high == 0xFFFFFFFFu || from <= high + 1))
+            {
+                high = std::max(high, to);
+                continue;
+            }
+            if (pending) emit(low, high);
+            pending = true;
+            low = from;
+            high = to;
+        }
+        if (pending) emit(low, high);
+        flush();
+        return result;
+    }
+
+    // Наименьший и наибольший элементы непустого множества
+    int minimum() const
+    {
+        return toSigned((static_cast<uint32_t>(keys.front()) << 16) | containers.front().first());
+    }
+
+    int maximum() const
+    {
+        return toSigned((static_cast<uint32_t>(keys.back()) << 16) | containers.back().last());
+    }
+
+    // Все элементы лежат в отрезке [first, last]
+    bool within(int first, int last) const
+    {
+        return empty() || (minimum() >= first && maximum() <= last);
+    }
+
+    // Обход элементов по возрастанию
+    template <typename Func>
+    void forEach(Func func) const
+    {
+        for (size_t c = 0; c < containers.size(); c++)
+        {
+            uint32_t high = static_cast<uint32_t>(keys[c]) << 16;
+            containers[c].forEach([&](uint16_t low) { func(toSigned(high | low)); });
+        }
+    }
+
+    // Обход с возможностью остановки: func возвращает false, чтобы прекратить обход
+    template <typename Func>
+    void forEachWhile(Func func) const
+    {
+        bool proceed = true;
+        for (size_t c = 0; c < containers.size() && proceed; c++)
+        {
+            uint32_t high = static_cast<uint32_t>(keys[c]) << 16;
+            containers[c].forEach([&](uint16_t low)
+            {
+                if (proceed) proceed = func(toSigned(high | low));
+            });
+        }
+    }
+
+    // То же, начиная с элемента с номером rank (нумерация с нуля по возрастанию).
+    // Блоки до него пропускаются целиком по мощности, без обхода элементов
+    template <typename Func>
+    void forEachWhileFrom(uint64_t rank, Func func) const
+    {
+        size_t c = 0;
+        for (; c < containers.size() && rank >= static_cast<uint64_t>(containers[c].size()); c++) rank -= containers[c].size();
+        bool proceed = true;
+        for (; c < containers.size() && proceed; c++)
+        {
+            uint32_t high = static_cast<uint32_t>(keys[c]) << 16;
+            uint64_t skip = rank;
+            rank = 0;
+            containers[c].forEach([&](uint16_t low)
+            {
+                if (skip > 0) skip--;
+                else if (proceed) proceed = func(toSigned(high | low));
+            });
+        }
+    }
+
+    // Бинарная операция по блокам: блоки одного операнда без пары обрабатываются без слияния
+    static RoaringSet combine(const RoaringSet& a, const RoaringSet& b, SetOperation op)
+    {
+        return combine(a, b, op, 0, 65535);
+    }
+
+    // Операция только над блоками с ключами из [firstKey, lastKey]; части с разными
+    // диапазонами ключей независимы и могут строиться параллельно, а затем склеиваться appendAll
+    static RoaringSet combine(const RoaringSet& a, const RoaringSet& b, SetOperation op, uint16_t firstKey, uint16_t lastKey)
+    {
+        RoaringSet result;
+        bool keepLeftOnly = applyOperation(op, true, false);
+        bool keepRightOnly = applyOperation(op, false, true);
+        size_t i = std::lower_bound(a.keys.begin(), a.keys.end(), firstKey) - a.keys.begin();
+        size_t j = std::lower_bound(b.keys.begin(), b.keys.end(), firstKey) - b.keys.begin();
+        size_t aEnd = std::upper_bound(a.keys.begin(), a.keys.end(), lastKey) - a.keys.begin();
+        size_t bEnd = std::upper_bound(b.keys.begin(), b.keys.end(), lastKey) - b.keys.begin();
+        while (i < aEnd || j < bEnd)
+        {
+            if (j == bEnd || (i < aEnd && a.keys[i] < b.keys[j]))
+            {
+                if (keepLeftOnly) result.appendContainer(a.keys[i], Container(a.containers[i]));
+                i++;
+            }
+            else if (i == aEnd || b.keys[j] < a.keys[i])
+            {
+                if (keepRightOnly) result.appendContainer(b.keys[j], Container(b.containers[j]));
+                j++;
+            }
+            else
+            {
+                result.appendContainer(a.keys[i], Container::combine(a.containers[i], b.containers[j], op));
+                i++;
+                j++;
+            }
+        }
+        return result;
+    }
+
+    // Перенос в конец всех блоков part; её ключи должны быть больше ключей этого множества
+    void appendAll(RoaringSet&& part)
+    {
+        keys.insert(keys.end(), part.keys.begin(), part.keys.end());
+        containers.insert(containers.end(), std::make_move_iterator(part.containers.begin()), std::make_move_iterator(part.containers.end()));
+        part.clear();
+    }
+
+    // Мощность пересечения без построения множества
+    static uint64_t intersectionSize(const RoaringSet& a, const RoaringSet& b)
+    {
+        uint64_t total = 0;
+        size_t i = 0, j = 0;
+        while (i < a.keys.size() && j < b.keys.size())
+        {
+            if (a.keys[i] < b.keys[j]) i++;
+            else if (b.keys[j] < a.keys[i]) j++;
+            else total += Container::intersectionSize(a.containers[i++], b.containers[j++]);
+        }
+        return total;
+    }
+
+    // Мощность результата операции: |A+B| = |A|+|B|-|A*B|, |A-B| = |A|-|A*B|, |A^B| = |A|+|B|-2|A*B|
+    static uint64_t combinedSize(const RoaringSet& a, const RoaringSet& b, SetOperation op)
+    {
+        uint64_t common = intersectionSize(a, b);
+        switch (op)
+        {
+        case SetOperation::Union: return a.size() + b.size() - common;
+        case SetOperation::Intersection: return common;
+        case SetOperation::Difference: return a.size() - common;
+        case SetOperation::SymmetricDifference: return a.size() + b.size() - 2 * common;
+        }
+        return 0;
+    }
+
+    // Есть ли у множеств общий элемент (проверка останавливается на первом найденном)
+    static bool intersects(const RoaringSet& a, const RoaringSet& b)
+    {
+        size_t i = 0, j = 0;
+        while (i < a.keys.size() && j < b.keys.size())
+        {
+            if (a.keys[i] < b.keys[j]) i++;
+            else if (b.keys[j] < a.keys[i]) j++;
+            else if (Container::intersects(a.containers[i++], b.containers[j++])) return true;
+        }
+        return false;
+    }
+
+    // a - подмножество b (проверка останавливается на первом блоке с контрпримером)
+    static bool isSubset(const RoaringSet& a, const RoaringSet& b)
+    {
+        size_t j = 0;
+        for (size_t i = 0; i < a.keys.size(); i++)
+        {
+            while (j < b.keys.size() && b.keys[j] < a.keys[i]) j++;
+            if (j == b.keys.size() || b.keys[j] != a.keys[i]) return false;
+            if (!a.containers[i].isSubsetOf(b.containers[j])) return false;
+        }
+        return true;
+    }
+
+    static bool equals(const RoaringSet& a, const RoaringSet& b)
+    {
+        if (a.keys != b.keys) return false;
+        for (size_t i = 0; i < a.containers.size(); i++)
+        {
+            if (a.containers[i].size() != b.containers[i].size() || !a.containers[i].isSubsetOf(b.containers[i])) return false;
+        }
+        return true;
+    }
+
+    RoaringSet complement(int first, int last) const
+    {
+        RoaringSet result;
+        if (first > last) return result;
+        uint32_t from = toUnsigned(first), to = toUnsigned(last);
+        size_t c = std::lower_bound(keys.begin(), keys.end(), static_cast<uint16_t>(from >> 16)) - keys.begin();
+        for (uint32_t key = from >> 16; key <= (to >> 16); key++)
+        {
+            uint16_t low = key == (from >> 16) ? static_cast<uint16_t>(from & 0xFFFF) : 0;
+            uint16_t high = key == (to >> 16) ? static_cast<uint16_t>(to & 0xFFFF) : 65535;
+            if (c < keys.size() && keys[c] == key)
+            {
+                result.appendContainer(static_cast<uint16_t>(key), containers[c].complement(low, high));
+                c++;
+            }
+            else
+            {
+                result.appendContainer(static_cast<uint16_t>(key), Container::full(low, high));
+            }
+        }
+        return result;
+    }
+};
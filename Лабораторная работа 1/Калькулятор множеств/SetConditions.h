@@ -0,0 +1,178 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "BitOps.h"
+#include "RoaringSet.h"
+
+// Построение множества по условиям без перебора элементов.
+// Каждое условие компилируется в генератор 64-битных масок: для слова, описывающего
+// 64 подряд идущих числа, генератор сразу выдаёт биты подходящих чисел. Маски условий
+// пересекаются пословно, так что построение стоит O(размер универсума / 64).
+//   - чётность: чередующийся шаблон 0101... или 1010...;
+//   - знак и диапазон: отрезок, который заранее сужает обрабатываемые блоки;
+//   - кратность и класс вычетов: периодический шаблон, сдвигаемый от слова к слову.
+
+enum class ConditionType
+{
+    Parity = 1,     // first: 0 - чётные, 1 - нечётные
+    Sign,           // first: 0 - положительные, 1 - отрицательные, 2 - ноль
+    Multiple,       // Кратные first (при first = 0 условию не удовлетворяет ни одно число)
+    Range,          // first <= x <= second
+    Residue         // x mod second = first (second > 0; при first вне [0, second) подходящих чисел нет)
+};
+
+struct SetCondition
+{
+    ConditionType type;
+    int first;
+    int second;
+};
+
+class ConditionSetBuilder
+{
+private:
+    // Генератор масок класса вычетов x = residue (mod modulus)
+    struct PeriodicMask
+    {
+        long long modulus;
+        long long step;         // 64 mod modulus: смещение фазы при переходе к следующему слову
+        uint64_t pattern;       // Биты 0, m, 2m, ... для modulus <= 64
+        long long offset;       // Номер первого подходящего бита текущего слова по модулю modulus
+
+        PeriodicMask(long long residue, long long m, long long firstValue)
+            : modulus(m), step(64 % m), pattern(0)
+        {
+            if (m <= 64)
+            {
+                for (long long bit = 0; bit < 64; bit += m) pattern |= 1ULL << bit;
+            }
+            offset = ((residue - firstValue) % m + m) % m;
+        }
+
+        uint64_t next()
+        {
+            uint64_t mask = 0;
+            if (modulus <= 64) mask = pattern << offset;
+            else if (offset < 64) mask = 1ULL << offset;
+            offset -= step;
+            if (offset < 0) offset += modulus;
+            return mask;
+        }
+    };
+
+    // Условие знака как отрезок значений
+    static void signRange(int sign, long long& low, long long& high)
+    {
+        if (sign == 0)
+        {
+            low = 1;
+            high = INT32_MAX;
+        }
+        else if (sign == 1)
+        {
+            low = INT32_MIN;
+            high = -1;
+        }
+        else
+        {
+            low = 0;
+            high = 0;
+        }
+    }
+
+public:
+    // Множество чисел из [universeMin, universeMax], удовлетворяющих всем условиям
+    static RoaringSet build(const std::vector<SetCondition>& conditions, int universeMin, int universeMax)
+    {
+        // Отрезковые условия сужают область построения
+        long long low = universeMin, high = universeMax;
+        bool parityFixed = false;
+        int parity = 0;
+        std::vector<std::pair<long long, long long>> residues;   // (остаток, модуль)
+        for (const SetCondition& condition : conditions)
+        {
+            switch (condition.type)
+            {
+            case ConditionType::Parity:
+                // Два противоречащих условия чётности дают пустое множество
+                if (parityFixed && parity != (condition.first == 0 ? 0 : 1)) return RoaringSet();
+                parityFixed = true;
+                parity = condition.first == 0 ? 0 : 1;
+                break;
+            case ConditionType::Sign:
+            {
+                long long signLow, signHigh;
+                signRange(condition.first, signLow, signHigh);
+                low = std::max(low, signLow);
+                high = std::min(high, signHigh);
+                break;
+            }
+            case ConditionType::Range:
+                low = std::max(low, static_cast<long long>(condition.first));
+                high = std::min(high, static_cast<long long>(condition.second));
+                break;
+            case ConditionType::Multiple:
+                if (condition.first == 0) return RoaringSet();
+                residues.push_back({ 0, std::abs(static_cast<long long>(condition.first)) });
+                break;
+            case ConditionType::Residue:
+                if (condition.second <= 0 || condition.first < 0 || condition.first >= condition.second) return RoaringSet();
+                residues.push_back({ condition.first, condition.second });
+                break;
+            }
+        }
+        if (low > high) return RoaringSet();
+
+        // Кратность 1 и остаток по модулю 1 не ограничивают множество
+        residues.erase(std::remove_if(residues.begin(), residues.end(),
+            [](const std::pair<long long, long long>& r) { return r.second == 1; }), residues.end());
+
+        RoaringSet result;
+        uint32_t from = RoaringSet::toUnsigned(static_cast<int>(low));
+        uint32_t to = RoaringSet::toUnsigned(static_cast<int>(high));
+        std::vector<uint64_t> words(Container::ChunkBitmap::WordCount);
+
+        for (uint32_t key = from >> 16; key <= (to >> 16); key++)
+        {
+            uint16_t first = key == (from >> 16) ? static_cast<uint16_t>(from & 0xFFFF) : 0;
+            uint16_t last = key == (to >> 16) ? static_cast<uint16_t>(to & 0xFFFF) : 65535;
+
+            // Только отрезок: блок заполняется целиком без пословного прохода
+            if (!parityFixed && residues.empty())
+            {
+                result.appendContainer(static_cast<uint16_t>(key), Container::full(first, last));
+                continue;
+            }
+
+            // Число, соответствующее нулевому биту блока
+            long long chunkStart = RoaringSet::toSigned(key << 16);
+            std::vector<PeriodicMask> generators;
+            for (const auto& r : residues) generators.push_back(PeriodicMask(r.first, r.second, chunkStart));
+
+            // Начало блока кратно 64, поэтому шаблон чётности одинаков для всех слов
+            uint64_t parityMask = !parityFixed ? ~0ULL : (parity == 0 ? 0x5555555555555555ULL : 0xAAAAAAAAAAAAAAAAULL);
+
+            int count = 0;
+            for (int w = 0; w < Container::ChunkBitmap::WordCount; w++)
+            {
+                uint32_t wordStart = static_cast<uint32_t>(w) * 64;
+                uint64_t mask = parityMask;
+                if (wordStart + 63 < first || wordStart > last) mask = 0;
+                else
+                {
+                    if (first > wordStart) mask &= ~0ULL << (first - wordStart);
+                    if (last < wordStart + 63) mask &= lowMask(static_cast<int>(last - wordStart) + 1);
+                }
+                // Генераторы продвигаются на каждом слове, чтобы не сбивалась фаза
+                for (PeriodicMask& generator : generators) mask &= generator.next();
+                words[w] = mask;
+                count += bitCount(mask);
+            }
+            if (count > 0) result.appendContainer(static_cast<uint16_t>(key), Container::fromWords(words.data(), count));
+        }
+        return result;
+    }
+};
@@ -0,0 +1,270 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "BitOps.h"
+#include "RoaringSet.h"
+#include "ThreadPool.h"
+
+// Ленивый перебор подмножеств и декартова произведения.
+// Ни булеан, ни произведение не строятся: каждое из них - пронумерованная последовательность,
+// элемент которой вычисляется по номеру, а следующий получается из текущего за O(1).
+//   - булеан множества из n <= 63 элементов: подмножество с номером i - битовая маска i
+//     над элементами, упорядоченными по возрастанию;
+//   - подмножества из k элементов: маски с k единицами по возрастанию (colex-порядок),
+//     следующая маска - трюк Госпера, маска по номеру - комбинаторная система счисления;
+//   - произведение: кортеж с номером i - запись i в смешанной системе счисления
+//     с основаниями |A1|, ..., |Am|.
+// Память постоянна: хранятся только элементы исходного множества (не больше 63) или
+// указатели на сомножители. Любой отрезок номеров [begin, end) перебирается независимо
+// (forRange), поэтому перебор делится между потоками по отрезкам номеров (forEachRangeParallel).
+
+// Элементы множества, занумерованные битами маски
+class MaskedElements
+{
+public:
+    static const int MaxElements = 63;
+    typedef uint64_t Item;      // Подмножество - маска над elements
+
+protected:
+    int elements[MaxElements];
+    int count;
+
+    explicit MaskedElements(const RoaringSet& set)
+        : count(0)
+    {
+        set.forEachWhile([&](int value)
+        {
+            elements[count++] = value;
+            return count < MaxElements;
+        });
+    }
+
+public:
+    // Булеан и подмножества строятся только для множеств не больше MaxElements
+    static bool fits(const RoaringSet& set)
+    {
+        return set.size() <= static_cast<uint64_t>(MaxElements);
+    }
+
+    int elementCount() const
+    {
+        return count;
+    }
+
+    // Элементы подмножества mask по возрастанию
+    template <typename Func>
+    void forEachElement(uint64_t mask, Func func) const
+    {
+        for (; mask != 0; mask &= mask - 1) func(elements[lowestBit(mask)]);
+    }
+};
+
+// Все подмножества множества (set должно удовлетворять MaskedElements::fits)
+class PowerSetEnumerator : public MaskedElements
+{
+public:
+    explicit PowerSetEnumerator(const RoaringSet& set)
+        : MaskedElements(set)
+    {
+    }
+
+    uint64_t size() const
+    {
+        return 1ULL << count;
+    }
+
+    // func(mask) для подмножеств с номерами из [begin, end)
+    template <typename Func>
+    void forRange(uint64_t begin, uint64_t end, Func func) const
+    {
+        for (uint64_t mask = begin; mask < end; mask++) func(mask);
+    }
+};
+
+// Подмножества из k элементов (set должно удовлетворять MaskedElements::fits)
+class CombinationEnumerator : public MaskedElements
+{
+private:
+    int choose;
+
+    // Таблица биномиальных коэффициентов C(n, k) для n, k <= 63; строится один раз
+    struct BinomialTable
+    {
+        uint64_t values[64][64];
+
+        BinomialTable()
+        {
+            for (int n = 0; n < 64; n++)
+            {
+                values[n][0] = 1;
+                for (int k = 1; k < 64; k++) values[n][k] = n == 0 ? 0 : values[n - 1][k - 1] + values[n - 1][k];
+            }
+        }
+    };
+
+    static uint64_t binomial(int n, int k)
+    {
+        static const BinomialTable table;
+        return table.values[n][k];
+    }
+
+    // Трюк Госпера: следующее по возрастанию число с тем же количеством единиц
+    static uint64_t nextMask(uint64_t mask)
+    {
+        uint64_t lowest = mask & (0 - mask);
+        uint64_t ripple = mask + lowest;
+        return ripple | (((ripple ^ mask) >> 2) >> lowestBit(lowest));
+    }
+
+    // Маска с номером rank: rank = C(c_k, k) + ... + C(c_1, 1), где c_k > ... > c_1 - номера битов
+    uint64_t maskAt(uint64_t rank) const
+    {
+        uint64_t mask = 0;
+        int bit = count;
+        for (int i = choose; i > 0; i--)
+        {
+            do bit--; while (binomial(bit, i) > rank);
+            mask |= 1ULL << bit;
+            rank -= binomial(bit, i);
+        }
+        return mask;
+    }
+
+public:
+    CombinationEnumerator(const RoaringSet& set, int k)
+        : MaskedElements(set), choose(k)
+    {
+    }
+
+    // C(n, k); 0 при k > n
+    uint64_t size() const
+    {
+        return choose < 0 || choose > count ? 0 : binomial(count, choose);
+    }
+
+    template <typename Func>
+    void forRange(uint64_t begin, uint64_t end, Func func) const
+    {
+        if (begin >= end) return;
+        uint64_t mask = maskAt(begin);
+        for (uint64_t i = begin; ; )
+        {
+            func(mask);
+            if (++i == end) break;
+            mask = nextMask(mask);
+        }
+    }
+};
+
+// Декартово произведение A1 x ... x Am; кортежи по возрастанию в лексикографическом порядке
+class ProductEnumerator
+{
+public:
+    static const int MaxFactors = 16;
+    typedef const int* Item;    // Кортеж - массив из width() чисел
+
+private:
+    const RoaringSet* factors[MaxFactors];
+    uint64_t sizes[MaxFactors];
+    int factorCount;
+
+    // Обход сомножителя level, начиная с кортежа starts (на первом проходе) и до исчерпания remaining
+    template <typename Func>
+    bool walk(int level, const uint64_t* starts, bool fromStart, int* tuple, uint64_t& remaining, Func& func) const
+    {
+        bool proceed = true;
+        factors[level]->forEachWhileFrom(fromStart ? starts[level] : 0, [&](int value)
+        {
+            tuple[level] = value;
+            if (level + 1 == factorCount)
+            {
+                func(static_cast<const int*>(tuple));
+                proceed = --remaining > 0;
+            }
+            else
+            {
+                proceed = walk(level + 1, starts, fromStart, tuple, remaining, func);
+            }
+            fromStart = false;
+            return proceed;
+        });
+        return proceed;
+    }
+
+public:
+    // Число кортежей должно помещаться в 64 бита (см. fits)
+    explicit ProductEnumerator(const std::vector<const RoaringSet*>& sets)
+        : factorCount(static_cast<int>(sets.size()))
+    {
+        for (int i = 0; i < factorCount; i++)
+        {
+            factors[i] = sets[i];
+            sizes[i] = sets[i]->size();
+        }
+    }
+
+    // Сомножителей не больше MaxFactors и число кортежей не переполняет uint64_t
+    static bool fits(const std::vector<const RoaringSet*>& sets)
+    {
+        if (sets.empty() || sets.size() > static_cast<size_t>(MaxFactors)) return false;
+        uint64_t total = 1;
+        for (const RoaringSet* set : sets)
+        {
+            uint64_t size = set->size();
+            if (size == 0) return true;
+            if (total > UINT64_MAX / size) return false;
+            total *= size;
+        }
+        return true;
+    }
+
+    // Длина кортежа
+    int width() const
+    {
+        return factorCount;
+    }
+
+    uint64_t size() const
+    {
+        uint64_t total = 1;
+        for (int i = 0; i < factorCount; i++) total *= sizes[i];
+        return total;
+    }
+
+    // func(tuple) для кортежей с номерами из [begin, end)
+    template <typename Func>
+    void forRange(uint64_t begin, uint64_t end, Func func) const
+    {
+        if (begin >= end || end > size()) return;
+        uint64_t starts[MaxFactors];
+        uint64_t rest = begin;
+        for (int i = factorCount - 1; i >= 0; i--)
+        {
+            starts[i] = rest % sizes[i];
+            rest /= sizes[i];
+        }
+        int tuple[MaxFactors];
+        uint64_t remaining = end - begin;
+        walk(0, starts, true, tuple, remaining, func);
+    }
+};
+
+// Деление номеров [begin, end) на parts почти равных отрезков; func(part, from, to) вызывается
+// для каждого отрезка в потоках пула. Отрезки перебираются независимо, без общего состояния
+template <typename Func>
+void forEachRangeParallel(ThreadPool& pool, uint64_t begin, uint64_t end, size_t parts, Func func)
+{
+    if (begin >= end) return;
+    uint64_t total = end - begin;
+    if (parts == 0) parts = 1;
+    if (static_cast<uint64_t>(parts) > total) parts = static_cast<size_t>(total);
+    uint64_t step = total / parts, extra = total % parts;
+    pool.parallelFor(parts, 1, [&](size_t part)
+    {
+        uint64_t from = begin + step * part + std::min<uint64_t>(part, extra);
+        uint64_t to = from + step + (part < extra ? 1 : 0);
+        func(part, from, to);
+    });
+}
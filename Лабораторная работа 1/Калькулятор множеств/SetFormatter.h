@@ -0,0 +1,121 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Двоичная выгрузка пишет заголовок и числа байтами памяти, без перестановки, поэтому порядок байт
+// в файле совпадает с little-endian только на little-endian платформе (MSVC собирает только под такие)
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "SetFormatter: двоичная выгрузка поддерживается только на little-endian платформах"
+#endif
+
+// Вывод элементов множества через BufferedWriter или StringWriter (BufferedWriter.h):
+// числа форматируются std::to_chars прямо в буфер писателя, который сбрасывается крупными блоками.
+// Форматы:
+//   - List: {1, 2, 3, 7};
+//   - Intervals: подряд идущие числа - отрезком, {1..3, 7} (отрезки записываются так же, как в команде set);
+//   - двоичная выгрузка (writeBinary): заголовок и элементы int32 little-endian по возрастанию.
+// Set - любое множество с forEach по возрастанию и size() (RoaringSet, SetHandle).
+
+enum class SetFormat
+{
+    List,
+    Intervals
+};
+
+// Разбор названия формата: list или intervals; false, если название неизвестно
+inline bool parseSetFormat(const std::string& name, SetFormat& format)
+{
+    if (name == "list") format = SetFormat::List;
+    else if (name == "intervals") format = SetFormat::Intervals;
+    else return false;
+    return true;
+}
+
+// Заголовок двоичной выгрузки
+struct BinarySetHeader
+{
+    char magic[8];          // "SETDUMP1"
+    uint64_t count;         // Число элементов; за заголовком следуют count чисел int32
+};
+
+static_assert(sizeof(BinarySetHeader) == 16, "заголовок двоичной выгрузки должен занимать 16 байт");
+
+class SetFormatter
+{
+private:
+    // Элементов в одном блоке двоичной выгрузки
+    static const size_t BinaryBlock = 4096;
+
+    template <typename Writer>
+    static void writeInterval(Writer& out, long long first, long long last, bool& leading)
+    {
+        if (!leading) out.write(", ", 2);
+        leading = false;
+        out.writeInt(first);
+        if (last == first) return;
+        out.write("..", 2);
+        out.writeInt(last);
+    }
+
+public:
+    // Элементы в фигурных скобках без перевода строки
+    template <typename Writer, typename Set>
+    static void writeElements(Writer& out, const Set& set, SetFormat format)
+    {
+        out.write('{');
+        bool leading = true;
+        if (format == SetFormat::List)
+        {
+            set.forEach([&](int value)
+            {
+                if (!leading) out.write(", ", 2);
+                out.writeInt(value);
+                leading = false;
+            });
+        }
+        else
+        {
+            // Текущий отрезок [first, last] выводится, когда следующий элемент его не продолжает
+            long long first = 0, last = -2;
+            bool open = false;
+            set.forEach([&](int value)
+            {
+                if (open && value == last + 1)
+                {
+                    last = value;
+                    return;
+                }
+                if (open) writeInterval(out, first, last, leading);
+                first = last = value;
+                open = true;
+            });
+            if (open) writeInterval(out, first, last, leading);
+        }
+        out.write('}');
+    }
+
+    // Двоичная выгрузка: заголовок BinarySetHeader и элементы, собранные в блоки по BinaryBlock
+    template <typename Writer, typename Set>
+    static void writeBinary(Writer& out, const Set& set)
+    {
+        BinarySetHeader header;
+        std::memcpy(header.magic, "SETDUMP1", sizeof(header.magic));
+        header.count = set.size();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        int32_t block[BinaryBlock];
+        size_t used = 0;
+        set.forEach([&](int value)
+        {
+            block[used++] = static_cast<int32_t>(value);
+            if (used == BinaryBlock)
+            {
+                out.write(reinterpret_cast<const char*>(block), sizeof(block));
+                used = 0;
+            }
+        });
+        out.write(reinterpret_cast<const char*>(block), used * sizeof(int32_t));
+    }
+};
@@ -0,0 +1,533 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <functional>
+#include <cctype>
+#include <map>
+#include "RoaringSet.h"
+
+// Компилятор формул над множествами.
+// Грамматика (по убыванию приоритета):
+//   primary := имя | U | {} | ( expr )
+//   unary   := !unary | primary
+//   term    := unary { * unary }
+//   expr    := term { (+ | - | ^) term }
+// Бинарные операции левоассоциативны. Формула разбирается один раз в дерево (AST),
+// которое затем переводится в постфиксную программу для многократного вычисления.
+
+enum class FormulaOp : uint8_t
+{
+    Set,                    // Ссылка на множество (operand - номер множества)
+    Empty,                  // Пустое множество
+    Universe,               // Универсум
+    Complement,             // !X
+    Union,                  // X+Y
+    Intersection,           // X*Y
+    Difference,             // X-Y
+    SymmetricDifference     // X^Y
+};
+
+inline bool isBinary(FormulaOp op)
+{
+    return op >= FormulaOp::Union;
+}
+
+inline SetOperation toSetOperation(FormulaOp op)
+{
+    switch (op)
+    {
+    case FormulaOp::Intersection: return SetOperation::Intersection;
+    case FormulaOp::Difference: return SetOperation::Difference;
+    case FormulaOp::SymmetricDifference: return SetOperation::SymmetricDifference;
+    default: return SetOperation::Union;
+    }
+}
+
+inline FormulaOp toFormulaOp(SetOperation op)
+{
+    switch (op)
+    {
+    case SetOperation::Intersection: return FormulaOp::Intersection;
+    case SetOperation::Difference: return FormulaOp::Difference;
+    case SetOperation::SymmetricDifference: return FormulaOp::SymmetricDifference;
+    default: return FormulaOp::Union;
+    }
+}
+
+// Узел дерева формулы; дочерние узлы задаются индексами в массиве узлов
+struct FormulaNode
+{
+    FormulaOp op;
+    int operand;    // Для FormulaOp::Set - номер множества
+    int left;       // Единственный операнд унарной операции или левый операнд бинарной
+    int right;
+};
+
+// Команда постфиксной программы
+struct FormulaInstruction
+{
+    FormulaOp op;
+    int operand;
+};
+
+// Ошибка разбора формулы с позицией в исходной строке
+class FormulaError : public std::runtime_error
+{
+private:
+    size_t errorPosition;
+
+public:
+    FormulaError(const std::string& message, size_t position)
+        : std::runtime_error(message), errorPosition(position)
+    {
+    }
+
+    size_t position() const
+    {
+        return errorPosition;
+    }
+};
+
+enum class TokenType
+{
+    Identifier,
+    Operator,       // + * - ^
+    Not,            // !
+    LeftParen,
+    RightParen,
+    EmptySet,       // {} или ∅
+    End
+};
+
+struct Token
+{
+    TokenType type;
+    std::string text;
+    size_t position;
+};
+
+// Разбиение строки формулы на лексемы
+inline std::vector<Token> tokenizeFormula(const std::string& text)
+{
+    std::vector<Token> tokens;
+    size_t i = 0;
+    while (i < text.size())
+    {
+        char c = text[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            i++;
+            continue;
+        }
+
+        size_t start = i;
+        if (isalpha(static_cast<unsigned char>(c)) || c == '_')
+        {
+            while (i < text.size() && (isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_')) i++;
+            tokens.push_back({ TokenType::Identifier, text.substr(start, i - start), start });
+        }
+        else if (c == '+' || c == '*' || c == '-' || c == '^')
+        {
+            tokens.push_back({ TokenType::Operator, std::string(1, c), start });
+            i++;
+        }
+        else if (c == '!')
+        {
+            tokens.push_back({ TokenType::Not, "!", start });
+            i++;
+        }
+        else if (c == '(')
+        {
+            tokens.push_back({ TokenType::LeftParen, "(", start });
+            i++;
+        }
+        else if (c == ')')
+        {
+            tokens.push_back({ TokenType::RightParen, ")", start });
+            i++;
+        }
+        else if (c == '{' && i + 1 < text.size() && text[i + 1] == '}')
+        {
+            tokens.push_back({ TokenType::EmptySet, "{}", start });
+            i += 2;
+        }
+        else if (text.compare(i, 3, "\xE2\x88\x85") == 0)
+        {
+            tokens.push_back({ TokenType::EmptySet, "\xE2\x88\x85", start });
+            i += 3;
+        }
+        else
+        {
+            throw FormulaError(std::string("недопустимый символ '") + c + "'", start);
+        }
+    }
+    tokens.push_back({ TokenType::End, "", text.size() });
+    return tokens;
+}
+
+// Скомпилированная формула: дерево разбора и постфиксная программа
+class Formula
+{
+public:
+    // Возвращает номер множества по имени или -1, если такого множества нет
+    typedef std::function<int(const std::string&)> NameResolver;
+
+private:
+    std::string source;
+    std::vector<FormulaNode> nodes;
+    int rootNode;
+    std::vector<FormulaInstruction> program;
+    std::map<int, std::string> setNames;   // Имена множеств, на которые ссылается формула
+
+    // Состояние разбора
+    std::vector<Token> tokens;
+    size_t current;
+    NameResolver resolve;
+
+    static int precedence(const Token& token)
+    {
+        if (token.type != TokenType::Operator) return 0;
+        return token.text[0] == '*' ? 2 : 1;
+    }
+
+    static FormulaOp binaryOp(char symbol)
+    {
+        switch (symbol)
+        {
+        case '+': return FormulaOp::Union;
+        case '*': return FormulaOp::Intersection;
+        case '-': return FormulaOp::Difference;
+        default: return FormulaOp::SymmetricDifference;
+        }
+    }
+
+    int addNode(FormulaOp op, int operand, int left, int right)
+    {
+        nodes.push_back({ op, operand, left, right });
+        return static_cast<int>(nodes.size()) - 1;
+    }
+
+    const Token& peek() const
+    {
+        return tokens[current];
+    }
+
+    int parsePrimary()
+    {
+        const Token& token = peek();
+        switch (token.type)
+        {
+        case TokenType::Identifier:
+        {
+            current++;
+            int index = resolve(token.text);
+            if (index >= 0)
+            {
+                setNames[index] = token.text;
+                return addNode(FormulaOp::Set, index, -1, -1);
+            }
+            if (token.text == "U") return addNode(FormulaOp::Universe, -1, -1, -1);
+            throw FormulaError("неизвестное множество '" + token.text + "'", token.position);
+        }
+        case TokenType::EmptySet:
+            current++;
+            return addNode(FormulaOp::Empty, -1, -1, -1);
+        case TokenType::LeftParen:
+        {
+            current++;
+            int inner = parseExpression(1);
+            if (peek().type != TokenType::RightParen)
+            {
+                throw FormulaError("ожидалась ')'", peek().position);
+            }
+            current++;
+            return inner;
+        }
+        case TokenType::End:
+            throw FormulaError("неожиданный конец формулы", token.position);
+        default:
+            throw FormulaError("ожидалось множество, '!' или '(', а встретилось '" + token.text + "'", token.position);
+        }
+    }
+
+    int parseUnary()
+    {
+        if (peek().type == TokenType::Not)
+        {
+            current++;
+            int operand = parseUnary();
+            return addNode(FormulaOp::Complement, -1, operand, -1);
+        }
+        return parsePrimary();
+    }
+
+    // Разбор методом подъёма по приоритетам: поглощаем операции с приоритетом не ниже minPrecedence
+    int parseExpression(int minPrecedence)
+    {
+        int left = parseUnary();
+        while (precedence(peek()) >= minPrecedence)
+        {
+            Token op = peek();
+            current++;
+            int right = parseExpression(precedence(op) + 1);
+            left = addNode(binaryOp(op.text[0]), -1, left, right);
+        }
+        return left;
+    }
+
+    void emit(int node, std::vector<FormulaInstruction>& out) const
+    {
+        const FormulaNode& n = nodes[node];
+        if (n.left >= 0) emit(n.left, out);
+        if (n.right >= 0) emit(n.right, out);
+        out.push_back({ n.op, n.operand });
+    }
+
+    // Приоритет узла при печати: чем больше, тем сильнее связывание
+    static int bindingStrength(FormulaOp op)
+    {
+        switch (op)
+        {
+        case FormulaOp::Intersection: return 2;
+        case FormulaOp::Union:
+        case FormulaOp::Difference:
+        case FormulaOp::SymmetricDifference: return 1;
+        default: return 3;
+        }
+    }
+
+    static char symbol(FormulaOp op)
+    {
+        switch (op)
+        {
+        case FormulaOp::Union: return '+';
+        case FormulaOp::Intersection: return '*';
+        case FormulaOp::Difference: return '-';
+        default: return '^';
+        }
+    }
+
+public:
+    Formula() : rootNode(-1), current(0)
+    {
+    }
+
+    // Разбор формулы; при ошибке бросается FormulaError
+    static Formula compile(const std::string& text, const NameResolver& resolver)
+    {
+        Formula formula;
+        formula.source = text;
+        formula.tokens = tokenizeFormula(text);
+        formula.current = 0;
+        formula.resolve = resolver;
+
+        if (formula.peek().type == TokenType::End)
+        {
+            throw FormulaError("пустая формула", 0);
+        }
+        formula.rootNode = formula.parseExpression(1);
+        if (formula.peek().type != TokenType::End)
+        {
+            const Token& extra = formula.peek();
+            throw FormulaError(extra.type == TokenType::RightParen ? "лишняя ')'" : "ожидалась операция, а встретилось '" + extra.text + "'", extra.position);
+        }
+
+        formula.emit(formula.rootNode, formula.program);
+        formula.tokens.clear();
+        formula.resolve = nullptr;
+        return formula;
+    }
+
+    // Формула из готового дерева (например, после упрощения); текст восстанавливается по дереву
+    static Formula fromTree(const std::vector<FormulaNode>& treeNodes, int root, const std::map<int, std::string>& names)
+    {
+        Formula formula;
+        formula.nodes = treeNodes;
+        formula.rootNode = root;
+        formula.setNames = names;
+        formula.emit(root, formula.program);
+        formula.source = formula.format(root);
+        return formula;
+    }
+
+    const std::map<int, std::string>& names() const
+    {
+        return setNames;
+    }
+
+    // Запись поддерева с минимально необходимыми скобками
+    std::string format(int node) const
+    {
+        const FormulaNode& n = nodes[node];
+        switch (n.op)
+        {
+        case FormulaOp::Set:
+        {
+            auto it = setNames.find(n.operand);
+            return it != setNames.end() ? it->second : "#" + std::to_string(n.operand);
+        }
+        case FormulaOp::Empty: return "{}";
+        case FormulaOp::Universe: return "U";
+        case FormulaOp::Complement:
+        {
+            std::string inner = format(n.left);
+            return bindingStrength(nodes[n.left].op) < 3 ? "!(" + inner + ")" : "!" + inner;
+        }
+        default:
+        {
+            int strength = bindingStrength(n.op);
+            std::string left = format(n.left);
+            std::string right = format(n.right);
+            // Левый операнд одного уровня не требует скобок (левая ассоциативность), правый - требует
+            if (bindingStrength(nodes[n.left].op) < strength) left = "(" + left + ")";
+            if (bindingStrength(nodes[n.right].op) <= strength) right = "(" + right + ")";
+            return left + symbol(n.op) + right;
+        }
+        }
+    }
+
+    const std::string& text() const
+    {
+        return source;
+    }
+
+    const std::vector<FormulaNode>& tree() const
+    {
+        return nodes;
+    }
+
+    int root() const
+    {
+        return rootNode;
+    }
+
+    const std::vector<FormulaInstruction>& instructions() const
+    {
+        return program;
+    }
+
+    // Пооперационное вычисление постфиксной программы: каждая операция строит промежуточное множество.
+    // setAt(номер) возвращает ссылку на множество. Слитный вариант - FusedEvaluator.
+    template <typename SetLookup>
+    RoaringSet evaluateStepwise(SetLookup setAt, int universeMin, int universeMax) const
+    {
+        return runStepwise(program, setAt, universeMin, universeMax);
+    }
+
+    template <typename SetLookup>
+    static RoaringSet runStepwise(const std::vector<FormulaInstruction>& program, SetLookup setAt, int universeMin, int universeMax)
+    {
+        std::vector<RoaringSet> stack;
+        for (const FormulaInstruction& instruction : program)
+        {
+            switch (instruction.op)
+            {
+            case FormulaOp::Set:
+                stack.push_back(setAt(instruction.operand));
+                break;
+            case FormulaOp::Empty:
+                stack.push_back(RoaringSet());
+                break;
+            case FormulaOp::Universe:
+                stack.push_back(RoaringSet().complement(universeMin, universeMax));
+                break;
+            case FormulaOp::Complement:
+                stack.back() = stack.back().complement(universeMin, universeMax);
+                break;
+            default:
+            {
+                RoaringSet right = std::move(stack.back());
+                stack.pop_back();
+                stack.back() = RoaringSet::combine(stack.back(), right, toSetOperation(instruction.op));
+                break;
+            }
+            }
+        }
+        return std::move(stack.back());
+    }
+};
+
+// Запрос к формулам: значение формулы, её мощность или отношение между двумя формулами.
+// Синтаксис:
+//   F          - множество
+//   |F|        - мощность
+//   F <= G     - F подмножество G
+//   F >= G     - F надмножество G
+//   F == G     - множества равны
+//   F # G      - множества не пересекаются
+enum class QueryType
+{
+    Value,
+    Count,
+    Subset,
+    Superset,
+    Equal,
+    Disjoint
+};
+
+struct FormulaQuery
+{
+    QueryType type;
+    Formula left;
+    Formula right;     // Только для отношений
+};
+
+// Разбор части запроса; позиции ошибок пересчитываются относительно всей строки
+inline Formula compileQueryPart(const std::string& text, size_t offset, size_t length, const Formula::NameResolver& resolver)
+{
+    try
+    {
+        return Formula::compile(text.substr(offset, length), resolver);
+    }
+    catch (const FormulaError& error)
+    {
+        throw FormulaError(error.what(), offset + error.position());
+    }
+}
+
+inline FormulaQuery compileQuery(const std::string& text, const Formula::NameResolver& resolver)
+{
+    FormulaQuery query;
+    query.type = QueryType::Value;
+
+    size_t first = text.find_first_not_of(" \t");
+    size_t last = text.find_last_not_of(" \t");
+    if (first != std::string::npos && text[first] == '|')
+    {
+        if (last == first || text[last] != '|') throw FormulaError("ожидалась закрывающая '|'", last + 1);
+        query.type = QueryType::Count;
+        query.left = compileQueryPart(text, first + 1, last - first - 1, resolver);
+        return query;
+    }
+
+    // Знак отношения ищется вне скобок
+    int depth = 0;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        if (c == '(') depth++;
+        else if (c == ')') depth--;
+        if (depth != 0) continue;
+
+        size_t width = 2;
+        if (text.compare(i, 2, "<=") == 0) query.type = QueryType::Subset;
+        else if (text.compare(i, 2, ">=") == 0) query.type = QueryType::Superset;
+        else if (text.compare(i, 2, "==") == 0) query.type = QueryType::Equal;
+        else if (c == '#')
+        {
+            query.type = QueryType::Disjoint;
+            width = 1;
+        }
+        else continue;
+
+        query.left = compileQueryPart(text, 0, i, resolver);
+        query.right = compileQueryPart(text, i + width, std::string::npos, resolver);
+        return query;
+    }
+
+    query.left = Formula::compile(text, resolver);
+    return query;
+}
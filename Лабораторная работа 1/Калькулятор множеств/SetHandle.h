@@ -0,0 +1,181 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include "RoaringSet.h"
+#include "ThreadPool.h"
+#include "ParallelSetOps.h"
+
+// Множество с отложенным дополнением.
+// Значение - базовое множество или, если выставлен флаг дополнения, U \ base, где U = [universeMin, universeMax].
+// Дополнение берётся за O(1) переключением флага. Операции с дополненными операндами сводятся
+// к одной операции над базовыми множествами (withComplements: A*!B = A-B, !A+!B = !(A*B), ...),
+// мощность дополнения - |U| - |base|, отношения тоже проверяются по базовым множествам.
+// Само дополнение строится, только когда его элементы перечисляются (forEach) или нужен
+// обычный RoaringSet (materialize).
+// У дополненного значения base всегда лежит в U. Тождества с недополненным операндом верны, если и он
+// лежит в U; иначе (например, после сужения универсума) дополнение строится явно.
+class SetHandle
+{
+public:
+    typedef std::shared_ptr<const RoaringSet> SetPtr;
+
+private:
+    SetPtr base;
+    bool negated;
+    int universeMin;
+    int universeMax;
+
+    SetHandle(SetPtr set, bool complemented, int first, int last)
+        : base(std::move(set)), negated(complemented), universeMin(first), universeMax(last)
+    {
+    }
+
+    static SetPtr share(RoaringSet&& set)
+    {
+        return std::make_shared<const RoaringSet>(std::move(set));
+    }
+
+    // Множество без элементов вне [first, last]
+    static SetPtr clipped(const SetPtr& set, int first, int last)
+    {
+        if (set->within(first, last)) return set;
+        RoaringSet range;
+        range.addRange(first, last);
+        return share(RoaringSet::combine(*set, range, SetOperation::Intersection));
+    }
+
+    static RoaringSet combineSets(ThreadPool* pool, const RoaringSet& a, const RoaringSet& b, SetOperation op)
+    {
+        return pool ? ParallelSetOps::combine(*pool, a, b, op) : RoaringSet::combine(a, b, op);
+    }
+
+    uint64_t universeSize() const
+    {
+        return static_cast<uint64_t>(static_cast<long long>(universeMax) - universeMin + 1);
+    }
+
+    // |A ∪ B| = |U|: объединение покрывает универсум (оба множества лежат в U)
+    static bool coverUniverse(const SetHandle& a, const SetHandle& b)
+    {
+        SetPtr left = clipped(a.base, a.universeMin, a.universeMax);
+        SetPtr right = clipped(b.base, a.universeMin, a.universeMax);
+        return RoaringSet::combinedSize(*left, *right, SetOperation::Union) == a.universeSize();
+    }
+
+public:
+    // Множество set как значение (set не копируется)
+    SetHandle(SetPtr set, int first, int last)
+        : base(std::move(set)), negated(false), universeMin(first), universeMax(last)
+    {
+    }
+
+    // Дополнение set до универсума [first, last] за O(1); элементы set вне универсума отбрасываются
+    static SetHandle complementOf(SetPtr set, int first, int last)
+    {
+        return SetHandle(clipped(set, first, last), true, first, last);
+    }
+
+    SetHandle complement() const
+    {
+        // !!X = X ∩ U, а база дополнения уже лежит в U
+        return negated ? SetHandle(base, false, universeMin, universeMax) : complementOf(base, universeMin, universeMax);
+    }
+
+    bool isComplement() const
+    {
+        return negated;
+    }
+
+    const RoaringSet& baseSet() const
+    {
+        return *base;
+    }
+
+    // Операция над значениями; операнды должны относиться к одному универсуму.
+    // Выполняется одна операция над базовыми множествами, дополнение результата остаётся флагом
+    static SetHandle combine(const SetHandle& a, const SetHandle& b, SetOperation op, ThreadPool* pool = nullptr)
+    {
+        int first = a.universeMin, last = a.universeMax;
+        if (a.negated != b.negated)
+        {
+            const SetHandle& plain = a.negated ? b : a;
+            if (!plain.base->within(first, last))
+            {
+                // Недополненный операнд выходит за универсум: дополнение строится явно
+                SetPtr left = a.negated ? share(a.materialize()) : a.base;
+                SetPtr right = b.negated ? share(b.materialize()) : b.base;
+                return SetHandle(share(combineSets(pool, *left, *right, op)), first, last);
+            }
+        }
+
+        ComplementedOperation plan = withComplements(op, a.negated, b.negated);
+        const RoaringSet& left = plan.swapped ? *b.base : *a.base;
+        const RoaringSet& right = plan.swapped ? *a.base : *b.base;
+        SetPtr result = share(combineSets(pool, left, right, plan.op));
+        return plan.negated ? complementOf(result, first, last) : SetHandle(result, first, last);
+    }
+
+    uint64_t size() const
+    {
+        return negated ? universeSize() - base->size() : base->size();
+    }
+
+    // Значение как обычное множество; для дополнения это единственное место, где оно строится
+    RoaringSet materialize() const
+    {
+        return negated ? base->complement(universeMin, universeMax) : *base;
+    }
+
+    // Обход элементов по возрастанию; элементы дополнения - промежутки между элементами base
+    template <typename Func>
+    void forEach(Func func) const
+    {
+        if (!negated)
+        {
+            base->forEach(func);
+            return;
+        }
+        long long next = universeMin;
+        base->forEach([&](int value)
+        {
+            for (; next < value; next++) func(static_cast<int>(next));
+            next = static_cast<long long>(value) + 1;
+        });
+        for (; next <= universeMax; next++) func(static_cast<int>(next));
+    }
+
+    // a - подмножество b
+    static bool isSubset(const SetHandle& a, const SetHandle& b)
+    {
+        if (!a.negated && !b.negated) return RoaringSet::isSubset(*a.base, *b.base);
+        // !A ⊆ !B  <=>  B ⊆ A
+        if (a.negated && b.negated) return RoaringSet::isSubset(*b.base, *a.base);
+        // A ⊆ !B  <=>  A лежит в U и не пересекается с B
+        if (!a.negated) return a.base->within(a.universeMin, a.universeMax) && !RoaringSet::intersects(*a.base, *b.base);
+        // !A ⊆ B  <=>  A ∪ B покрывает U
+        return coverUniverse(a, b);
+    }
+
+    static bool disjoint(const SetHandle& a, const SetHandle& b)
+    {
+        if (!a.negated && !b.negated) return !RoaringSet::intersects(*a.base, *b.base);
+        // !A ∩ !B = !(A ∪ B) пусто  <=>  A ∪ B покрывает U
+        if (a.negated && b.negated) return coverUniverse(a, b);
+        // A ∩ !B пусто  <=>  A ∩ U ⊆ B
+        const SetHandle& plain = a.negated ? b : a;
+        const SetHandle& other = a.negated ? a : b;
+        return RoaringSet::isSubset(*clipped(plain.base, a.universeMin, a.universeMax), *other.base);
+    }
+
+    static bool equals(const SetHandle& a, const SetHandle& b)
+    {
+        if (a.negated == b.negated) return RoaringSet::equals(*a.base, *b.base);
+        // A = !B  <=>  A лежит в U, не пересекается с B и вместе с B покрывает U
+        const SetHandle& plain = a.negated ? b : a;
+        const SetHandle& other = a.negated ? a : b;
+        return plain.base->within(a.universeMin, a.universeMax) && !RoaringSet::intersects(*plain.base, *other.base)
+            && plain.base->size() + other.base->size() == a.universeSize();
+    }
+};
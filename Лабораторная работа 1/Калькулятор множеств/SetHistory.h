@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "RoaringSet.h"
+#include "PersistentSet.h"
+
+// История изменений именованных множеств на персистентных версиях (PersistentSet.h).
+// Для каждого имени хранится до MaxVersions последних версий; версии разделяют неизменившиеся
+// блоки, поэтому память и время фиксации пропорциональны изменению, а не размеру множества.
+// Снимок - набор текущих версий всех множеств под именем-меткой (копии указателей);
+// восстановление снимка и отмена сами записываются как новые версии.
+class SetHistory
+{
+public:
+    static const size_t MaxVersions = 64;
+
+    typedef std::vector<std::pair<std::string, PersistentSet>> Snapshot;
+
+private:
+    std::unordered_map<std::string, std::deque<PersistentSet>> versions;   // back() - текущая версия
+    std::map<std::string, Snapshot> snapshots;
+
+public:
+    // Фиксация содержимого working как текущей версии name (working забирается, см. PersistentSet::commit);
+    // возвращает текущую версию. Первой версией считается пустое множество (множество создаётся пустым)
+    PersistentSet commit(const std::string& name, RoaringSet&& working)
+    {
+        std::deque<PersistentSet>& list = versions[name];
+        if (list.empty()) list.push_back(PersistentSet());
+        PersistentSet next = PersistentSet::commit(std::move(working), list.back());
+        if (next.sameVersion(list.back())) return next;
+        list.push_back(next);
+        if (list.size() > MaxVersions) list.pop_front();
+        return next;
+    }
+
+    // Текущая версия name (пустая, если изменений не было)
+    PersistentSet current(const std::string& name) const
+    {
+        auto it = versions.find(name);
+        return it == versions.end() || it->second.empty() ? PersistentSet() : it->second.back();
+    }
+
+    // Предыдущая версия name; false, если отменять нечего
+    bool previous(const std::string& name, PersistentSet& version) const
+    {
+        auto it = versions.find(name);
+        if (it == versions.end() || it->second.size() < 2) return false;
+        version = it->second[it->second.size() - 2];
+        return true;
+    }
+
+    // Отмена последнего изменения: текущей становится предыдущая версия
+    bool undo(const std::string& name)
+    {
+        auto it = versions.find(name);
+        if (it == versions.end() || it->second.size() < 2) return false;
+        it->second.pop_back();
+        return true;
+    }
+
+    // История множества удаляется вместе с ним
+    void forget(const std::string& name)
+    {
+        versions.erase(name);
+    }
+
+    void saveSnapshot(const std::string& tag, Snapshot contents)
+    {
+        snapshots[tag] = std::move(contents);
+    }
+
+    // Снимок с меткой tag или nullptr
+    const Snapshot* findSnapshot(const std::string& tag) const
+    {
+        auto it = snapshots.find(tag);
+        return it == snapshots.end() ? nullptr : &it->second;
+    }
+};
@@ -0,0 +1,171 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cctype>
+#include "RoaringSet.h"
+
+// Реестр именованных множеств.
+// Множества лежат в пуле слотов, выделяемых блоками по SlotsPerBlock: номер слота служит
+// идентификатором множества и не меняется, пока множество существует. Освобождённые номера
+// и объекты слотов переиспользуются; данные множеств (ключи и контейнеры RoaringSet) при удалении
+// освобождаются и при следующей записи выделяются заново из общей кучи.
+// Поиск по имени - через хеш-таблицу за O(1).
+// Каждое изменение множества получает новый номер версии из общего счётчика реестра,
+// так что версия однозначно определяет содержимое слота даже после его переиспользования.
+class SetRegistry
+{
+public:
+    static const int SlotsPerBlock = 256;
+
+private:
+    struct Slot
+    {
+        RoaringSet set;
+        std::string name;
+        uint64_t version = 0;
+        bool used = false;
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> blocks;
+    std::vector<int> freeSlots;
+    std::unordered_map<std::string, int> byName;
+    int slotCount = 0;
+    uint64_t clock = 0;
+
+    Slot& slot(int id)
+    {
+        return blocks[id / SlotsPerBlock][id % SlotsPerBlock];
+    }
+
+    const Slot& slot(int id) const
+    {
+        return blocks[id / SlotsPerBlock][id % SlotsPerBlock];
+    }
+
+    int allocateSlot()
+    {
+        if (!freeSlots.empty())
+        {
+            int id = freeSlots.back();
+            freeSlots.pop_back();
+            return id;
+        }
+        if (slotCount % SlotsPerBlock == 0)
+        {
+            blocks.push_back(std::unique_ptr<Slot[]>(new Slot[SlotsPerBlock]));
+        }
+        return slotCount++;
+    }
+
+public:
+    // Команды пакетного режима: строка, начинающаяся с такого слова, читается как команда,
+    // поэтому множество с таким именем нельзя было бы поставить в начало формулы
+    static bool isBatchCommand(const std::string& word)
+    {
+        static const char* const commands[] = { "universe", "set", "drop", "seed", "random", "save", "load", "subsets", "product", "format", "export",
+            "snapshot", "restore", "undo", "diff", "bag", "tobag", "toset" };
+        for (const char* name : commands)
+        {
+            if (word == name) return true;
+        }
+        return false;
+    }
+
+    // Имя множества: латинская буква или '_', затем буквы, цифры и '_'; U зарезервировано за универсумом,
+    // команды пакетного режима - за сценариями
+    static bool validName(const std::string& name)
+    {
+        if (name.empty() || name == "U" || isBatchCommand(name)) return false;
+        if (!isalpha(static_cast<unsigned char>(name[0])) && name[0] != '_') return false;
+        for (char c : name)
+        {
+            if (!isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+        }
+        return true;
+    }
+
+    // Идентификатор множества по имени или -1
+    int find(const std::string& name) const
+    {
+        auto it = byName.find(name);
+        return it != byName.end() ? it->second : -1;
+    }
+
+    // Создание пустого множества; если имя уже занято, возвращается существующее множество
+    int create(const std::string& name)
+    {
+        int existing = find(name);
+        if (existing >= 0) return existing;
+
+        int id = allocateSlot();
+        Slot& s = slot(id);
+        s.name = name;
+        s.used = true;
+        s.version = ++clock;
+        s.set.clear();
+        byName[name] = id;
+        return id;
+    }
+
+    bool drop(const std::string& name)
+    {
+        int id = find(name);
+        if (id < 0) return false;
+        Slot& s = slot(id);
+        s.used = false;
+        s.version = ++clock;
+        s.set.clear();
+        byName.erase(name);
+        freeSlots.push_back(id);
+        return true;
+    }
+
+    bool exists(int id) const
+    {
+        return id >= 0 && id < slotCount && slot(id).used;
+    }
+
+    const RoaringSet& at(int id) const
+    {
+        return slot(id).set;
+    }
+
+    // Доступ для изменения: множество получает новую версию
+    RoaringSet& modify(int id)
+    {
+        Slot& s = slot(id);
+        s.version = ++clock;
+        return s.set;
+    }
+
+    uint64_t version(int id) const
+    {
+        return slot(id).version;
+    }
+
+    const std::string& nameOf(int id) const
+    {
+        return slot(id).name;
+    }
+
+    size_t size() const
+    {
+        return byName.size();
+    }
+
+    // Идентификаторы существующих множеств в порядке слотов
+    std::vector<int> ids() const
+    {
+        std::vector<int> result;
+        result.reserve(byName.size());
+        for (int id = 0; id < slotCount; id++)
+        {
+            if (slot(id).used) result.push_back(id);
+        }
+        return result;
+    }
+};
@@ -0,0 +1,202 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "BitOps.h"
+#include "RoaringSet.h"
+#include "ThreadPool.h"
+
+// Случайные подмножества ровно из k различных чисел отрезка [first, last] (n чисел).
+// Способ выбирается по плотности выборки:
+//   - k * DenseRatio < n: алгоритм Флойда - ровно k обращений к генератору без повторных попыток,
+//     выбранные смещения сортируются и раскладываются по блокам;
+//   - плотная выборка: биты отмечаются прямо в битовых картах блоков; при k <= n/2
+//     на повторные попадания уходит не больше половины обращений;
+//   - k > n/2: выбираются n - k исключаемых чисел, результат - их дополнение до отрезка.
+// Генератор создаётся один раз; при одинаковом зерне выборки повторяются от запуска к запуску.
+class SetSampler
+{
+public:
+    // Выборка плотная, если выбирается не меньше 1/DenseRatio чисел отрезка
+    static const uint64_t DenseRatio = 32;
+
+private:
+    std::mt19937_64 engine;
+
+    // Равномерное число из [0, bound), bound <= 2^32: умножение со сдвигом вместо деления (метод Лемира),
+    // редкие значения из неполного последнего отрезка отбрасываются, поэтому распределение точно равномерное
+    uint64_t below(uint64_t bound)
+    {
+        uint64_t product = (engine() >> 32) * bound;
+        if ((product & 0xFFFFFFFFULL) < bound)
+        {
+            uint64_t threshold = (0x100000000ULL - bound) % bound;
+            while ((product & 0xFFFFFFFFULL) < threshold) product = (engine() >> 32) * bound;
+        }
+        return product >> 32;
+    }
+
+    // Перемешивание зерна (splitmix64): соседние номера дают независимые генераторы
+    static uint64_t mixSeed(uint64_t seed, uint64_t index)
+    {
+        uint64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Множество из отсортированных смещений относительно first
+    static RoaringSet fromOffsets(const std::vector<uint64_t>& offsets, int first)
+    {
+        RoaringSet result;
+        uint32_t base = RoaringSet::toUnsigned(first);
+        size_t i = 0;
+        while (i < offsets.size())
+        {
+            uint32_t key = static_cast<uint32_t>(base + offsets[i]) >> 16;
+            std::vector<uint16_t> lows;
+            for (; i < offsets.size() && (static_cast<uint32_t>(base + offsets[i]) >> 16) == key; i++)
+            {
+                lows.push_back(static_cast<uint16_t>((base + offsets[i]) & 0xFFFF));
+            }
+            Container container = Container::fromArray(std::move(lows));
+            container.optimize();
+            result.appendContainer(static_cast<uint16_t>(key), std::move(container));
+        }
+        return result;
+    }
+
+    // Хеш-таблица выбранных смещений с открытой адресацией: одно обращение к памяти на проверку
+    // вместо узлов std::unordered_set, заполнение не больше половины
+    class OffsetTable
+    {
+    private:
+        std::vector<uint64_t> slots;    // offset + 1, ноль - свободная ячейка
+        size_t mask;
+
+    public:
+        explicit OffsetTable(uint64_t capacity)
+        {
+            size_t size = 16;
+            while (size < capacity * 2) size <<= 1;
+            slots.assign(size, 0);
+            mask = size - 1;
+        }
+
+        // false, если смещение уже было в таблице
+        bool insert(uint64_t offset)
+        {
+            uint64_t stored = offset + 1;
+            size_t i = static_cast<size_t>((stored * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+            while (slots[i] != 0)
+            {
+                if (slots[i] == stored) return false;
+                i = (i + 1) & mask;
+            }
+            slots[i] = stored;
+            return true;
+        }
+    };
+
+    // Алгоритм Флойда: на шаге j выбирается t из [0, j]; если t уже взято, берётся само j
+    RoaringSet sampleSparse(uint64_t k, uint64_t n, int first)
+    {
+        OffsetTable chosen(k);
+        std::vector<uint64_t> offsets;
+        offsets.reserve(static_cast<size_t>(k));
+        for (uint64_t j = n - k; j < n; j++)
+        {
+            uint64_t t = below(j + 1);
+            uint64_t pick = chosen.insert(t) ? t : j;
+            if (pick == j) chosen.insert(j);
+            offsets.push_back(pick);
+        }
+        std::sort(offsets.begin(), offsets.end());
+        return fromOffsets(offsets, first);
+    }
+
+    // Отметка случайных битов в битовых картах всех блоков отрезка (k <= n/2)
+    RoaringSet sampleDense(uint64_t k, uint64_t n, int first, int last)
+    {
+        const size_t chunkWords = Container::ChunkBitmap::WordCount;
+        uint32_t from = RoaringSet::toUnsigned(first), to = RoaringSet::toUnsigned(last);
+        uint32_t firstKey = from >> 16, lastKey = to >> 16;
+        uint64_t shift = from - (firstKey << 16);
+        std::vector<uint64_t> words(static_cast<size_t>(lastKey - firstKey + 1) * chunkWords);
+
+        for (uint64_t chosen = 0; chosen < k; )
+        {
+            uint64_t bit = shift + below(n);
+            uint64_t& word = words[static_cast<size_t>(bit >> 6)];
+            uint64_t mask = 1ULL << (bit & 63);
+            if (word & mask) continue;
+            word |= mask;
+            chosen++;
+        }
+
+        RoaringSet result;
+        for (uint32_t key = firstKey; key <= lastKey; key++)
+        {
+            const uint64_t* chunk = words.data() + static_cast<size_t>(key - firstKey) * chunkWords;
+            int count = 0;
+            for (size_t w = 0; w < chunkWords; w++) count += bitCount(chunk[w]);
+            if (count > 0) result.appendContainer(static_cast<uint16_t>(key), Container::fromWords(chunk, count));
+        }
+        return result;
+    }
+
+public:
+    explicit SetSampler(uint64_t seed)
+        : engine(seed)
+    {
+    }
+
+    // Зерно из системного источника случайности
+    static uint64_t randomSeed()
+    {
+        std::random_device device;
+        return (static_cast<uint64_t>(device()) << 32) ^ device();
+    }
+
+    void reseed(uint64_t seed)
+    {
+        engine.seed(seed);
+    }
+
+    // Новое зерно из текущего генератора (для порождаемых им независимых генераторов)
+    uint64_t nextSeed()
+    {
+        return engine();
+    }
+
+    // Случайное подмножество [first, last] из min(k, n) различных чисел
+    RoaringSet sample(uint64_t k, int first, int last)
+    {
+        RoaringSet result;
+        if (first > last || k == 0) return result;
+        uint64_t n = static_cast<uint64_t>(static_cast<long long>(last) - first + 1);
+        if (k >= n)
+        {
+            result.addRange(first, last);
+            return result;
+        }
+        if (k > n / 2) return sample(n - k, first, last).complement(first, last);
+        if (k * DenseRatio < n) return sampleSparse(k, n, first);
+        return sampleDense(k, n, first, last);
+    }
+
+    // count независимых выборок для нагрузочных проверок. Выборка i строится своим генератором
+    // с зерном, выведенным из (seed, i), поэтому результат не зависит от числа потоков
+    static std::vector<RoaringSet> sampleMany(ThreadPool& pool, size_t count, uint64_t k, int first, int last, uint64_t seed)
+    {
+        std::vector<RoaringSet> result(count);
+        pool.parallelFor(count, 1, [&](size_t i)
+        {
+            SetSampler sampler(mixSeed(seed, i));
+            result[i] = sampler.sample(k, first, last);
+        });
+        return result;
+    }
+};
@@ -0,0 +1,391 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "RoaringSet.h"
+#include "BufferedWriter.h"
+#include "SetRegistry.h"
+
+// Записи и данные контейнеров пишутся и читаются (через отображение) байтами памяти без перестановки,
+// поэтому файл соответствует формату little-endian только на little-endian платформе
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "SetSnapshot: двоичные снимки поддерживаются только на little-endian платформах"
+#endif
+
+// Двоичный снимок набора именованных множеств.
+// Данные контейнеров лежат в файле в том же виде, что и в памяти, поэтому при загрузке файл
+// отображается в адресное пространство (mmap / MapViewOfFile), а контейнеры работают прямо
+// со страницами отображения: читаются только заголовки, загрузка стоит O(числа контейнеров),
+// а страницы с данными подгружаются системой по мере обращения.
+// Формат (little-endian, смещения от начала файла):
+//   SnapshotHeader                       - сигнатура, версия, универсум, число множеств, размер файла
+//   SnapshotSetRecord[setCount]          - имя, мощность, число и смещение заголовков контейнеров
+//   для каждого множества: SnapshotContainerRecord[containerCount], затем имя
+//   данные контейнеров: битовые карты выровнены на 64 байта (строка кэша), массивы и отрезки - на 8
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t setCount;
+    int32_t universeMin;
+    int32_t universeMax;
+    uint64_t fileSize;
+    uint64_t reserved[4];
+};
+
+struct SnapshotSetRecord
+{
+    uint64_t nameOffset;
+    uint64_t containersOffset;
+    uint64_t cardinality;
+    uint32_t nameLength;
+    uint32_t containerCount;
+};
+
+struct SnapshotContainerRecord
+{
+    uint64_t payloadOffset;
+    uint32_t cardinality;
+    uint32_t count;         // Значений массива, отрезков или слов битовой карты
+    uint16_t key;
+    uint8_t type;           // ContainerType
+    uint8_t reserved[5];
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "SnapshotHeader layout");
+static_assert(sizeof(SnapshotSetRecord) == 32, "SnapshotSetRecord layout");
+static_assert(sizeof(SnapshotContainerRecord) == 24, "SnapshotContainerRecord layout");
+static_assert(sizeof(Run) == 4, "Run layout");
+static_assert(sizeof(Container::ChunkBitmap) == 8192, "ChunkBitmap layout");
+
+class SnapshotError : public std::runtime_error
+{
+public:
+    explicit SnapshotError(const std::string& message)
+        : std::runtime_error(message)
+    {
+    }
+};
+
+// Файл, отображённый в память только для чтения; отображение снимается в деструкторе
+class MappedFile
+{
+private:
+    const unsigned char* data;
+    size_t length;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path)
+        : data(nullptr), length(0)
+    {
+#if defined(_WIN32)
+        // FILE_SHARE_DELETE: save может заменить отображённый файл новым (см. SetSnapshot::save)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        mapping = nullptr;
+        if (file == INVALID_HANDLE_VALUE) throw SnapshotError("не удалось открыть файл " + path);
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+        {
+            CloseHandle(file);
+            throw SnapshotError("не удалось узнать размер файла " + path);
+        }
+        length = static_cast<size_t>(size.QuadPart);
+        if (length == 0) return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data == nullptr)
+        {
+            if (mapping != nullptr) CloseHandle(mapping);
+            CloseHandle(file);
+            throw SnapshotError("не удалось отобразить в память файл " + path);
+        }
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) throw SnapshotError("не удалось открыть файл " + path);
+        struct stat info;
+        if (fstat(descriptor, &info) != 0)
+        {
+            close(descriptor);
+            throw SnapshotError("не удалось узнать размер файла " + path);
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0)
+        {
+            void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (address == MAP_FAILED)
+            {
+                close(descriptor);
+                throw SnapshotError("не удалось отобразить в память файл " + path);
+            }
+            data = static_cast<const unsigned char*>(address);
+        }
+        // Отображение остаётся действительным и после закрытия дескриптора
+        close(descriptor);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#if defined(_WIN32)
+        if (data != nullptr) UnmapViewOfFile(data);
+        if (mapping != nullptr) CloseHandle(mapping);
+        CloseHandle(file);
+#else
+        if (data != nullptr) munmap(const_cast<unsigned char*>(data), length);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* bytes() const
+    {
+        return data;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+};
+
+class SetSnapshot
+{
+public:
+    static const uint32_t Version = 1;
+
+    // Содержимое загруженного снимка; контейнеры множеств ссылаются на отображение файла
+    // и удерживают его, пока живо хотя бы одно из них (или их копий)
+    struct Contents
+    {
+        int universeMin;
+        int universeMax;
+        std::vector<std::pair<std::string, RoaringSet>> sets;
+    };
+
+private:
+    static const char* magic()
+    {
+        return "SETSNAP\x1A";
+    }
+
+    static uint64_t alignUp(uint64_t offset, uint64_t alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    static uint64_t payloadAlignment(ContainerType type)
+    {
+        return type == ContainerType::Bitmap ? 64 : 8;
+    }
+
+    // Запись с дополнением нулями до смещения target
+    static void writeAt(std::FILE* file, uint64_t& position, uint64_t target, const void* data, size_t length)
+    {
+        static const char zeros[64] = {};
+        while (position < target)
+        {
+            size_t gap = static_cast<size_t>(std::min<uint64_t>(target - position, sizeof(zeros)));
+            std::fwrite(zeros, 1, gap, file);
+            position += gap;
+        }
+        if (length > 0) std::fwrite(data, 1, length, file);
+        position += length;
+    }
+
+    // Замена файла to файлом from одной операцией: старый файл остаётся доступным
+    // отображениям, которые на него уже ссылаются
+    static bool replaceFile(const std::string& from, const std::string& to)
+    {
+#if defined(_WIN32)
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+    }
+
+    static void check(bool condition, const std::string& path)
+    {
+        if (!condition) throw SnapshotError("файл " + path + " повреждён или не является снимком множеств");
+    }
+
+public:
+    // Запись множеств (имя, множество) в файл path. Файл может быть отображён предыдущей загрузкой,
+    // и его контейнеры могут быть среди записываемых, поэтому снимок пишется во временный файл
+    // рядом с path и затем заменяет path: перезапись на месте обрезала бы отображённые страницы
+    static void save(const std::string& path, const std::vector<std::pair<std::string, const RoaringSet*>>& sets, int universeMin, int universeMax)
+    {
+        // Первый проход: раскладка файла
+        std::vector<SnapshotSetRecord> setRecords(sets.size());
+        std::vector<std::vector<SnapshotContainerRecord>> containerRecords(sets.size());
+        uint64_t offset = sizeof(SnapshotHeader) + sets.size() * sizeof(SnapshotSetRecord);
+        for (size_t s = 0; s < sets.size(); s++)
+        {
+            const RoaringSet& set = *sets[s].second;
+            SnapshotSetRecord& record = setRecords[s];
+            offset = alignUp(offset, 8);
+            record.containersOffset = offset;
+            record.containerCount = static_cast<uint32_t>(set.containerCount());
+            record.cardinality = set.size();
+            offset += set.containerCount() * sizeof(SnapshotContainerRecord);
+            record.nameOffset = offset;
+            record.nameLength = static_cast<uint32_t>(sets[s].first.size());
+            offset += record.nameLength;
+        }
+        for (size_t s = 0; s < sets.size(); s++)
+        {
+            const RoaringSet& set = *sets[s].second;
+            containerRecords[s].resize(set.containerCount());
+            for (size_t c = 0; c < set.containerCount(); c++)
+            {
+                const Container& container = set.containerAt(c);
+                SnapshotContainerRecord& record = containerRecords[s][c];
+                std::memset(&record, 0, sizeof(record));
+                offset = alignUp(offset, payloadAlignment(container.type()));
+                record.payloadOffset = offset;
+                record.cardinality = static_cast<uint32_t>(container.size());
+                record.count = static_cast<uint32_t>(container.payloadCount());
+                record.key = set.keyAt(c);
+                record.type = static_cast<uint8_t>(container.type());
+                offset += container.payloadBytes();
+            }
+        }
+
+        SnapshotHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, magic(), sizeof(header.magic));
+        header.version = Version;
+        header.setCount = static_cast<uint32_t>(sets.size());
+        header.universeMin = universeMin;
+        header.universeMax = universeMax;
+        header.fileSize = offset;
+
+        // Второй проход: запись в порядке смещений
+        std::string temporary = path + ".tmp";
+        std::FILE* file = openFile(temporary, "wb");
+        if (file == nullptr) throw SnapshotError("не удалось создать файл " + temporary);
+        uint64_t position = 0;
+        writeAt(file, position, 0, &header, sizeof(header));
+        writeAt(file, position, position, setRecords.data(), setRecords.size() * sizeof(SnapshotSetRecord));
+        for (size_t s = 0; s < sets.size(); s++)
+        {
+            writeAt(file, position, setRecords[s].containersOffset, containerRecords[s].data(), containerRecords[s].size() * sizeof(SnapshotContainerRecord));
+            writeAt(file, position, setRecords[s].nameOffset, sets[s].first.data(), sets[s].first.size());
+        }
+        for (size_t s = 0; s < sets.size(); s++)
+        {
+            const RoaringSet& set = *sets[s].second;
+            for (size_t c = 0; c < set.containerCount(); c++)
+            {
+                const Container& container = set.containerAt(c);
+                writeAt(file, position, containerRecords[s][c].payloadOffset, container.payload(), container.payloadBytes());
+            }
+        }
+        bool failed = std::ferror(file) != 0;
+        if (std::fclose(file) != 0 || failed)
+        {
+            std::remove(temporary.c_str());
+            throw SnapshotError("ошибка записи в файл " + temporary);
+        }
+        if (!replaceFile(temporary, path))
+        {
+            std::remove(temporary.c_str());
+            throw SnapshotError("не удалось заменить файл " + path);
+        }
+    }
+
+    // Загрузка снимка отображением файла в память. Проверяются заголовки и границы данных,
+    // сами данные контейнеров не разбираются: файл должен быть записан функцией save
+    static Contents load(const std::string& path)
+    {
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(path);
+        const unsigned char* base = file->bytes();
+        uint64_t size = file->size();
+
+        check(size >= sizeof(SnapshotHeader), path);
+        const SnapshotHeader& header = *reinterpret_cast<const SnapshotHeader*>(base);
+        check(std::memcmp(header.magic, magic(), sizeof(header.magic)) == 0, path);
+        if (header.version != Version) throw SnapshotError("неподдерживаемая версия снимка в файле " + path);
+        check(header.fileSize == size && header.universeMin <= header.universeMax, path);
+        check(header.setCount <= (size - sizeof(SnapshotHeader)) / sizeof(SnapshotSetRecord), path);
+
+        Contents contents;
+        contents.universeMin = header.universeMin;
+        contents.universeMax = header.universeMax;
+        contents.sets.reserve(header.setCount);
+        const SnapshotSetRecord* setRecords = reinterpret_cast<const SnapshotSetRecord*>(base + sizeof(SnapshotHeader));
+        for (uint32_t s = 0; s < header.setCount; s++)
+        {
+            const SnapshotSetRecord& record = setRecords[s];
+            check(record.nameOffset <= size && record.nameLength <= size - record.nameOffset, path);
+            check(record.containersOffset % 8 == 0 && record.containersOffset <= size, path);
+            check(record.containerCount <= (size - record.containersOffset) / sizeof(SnapshotContainerRecord), path);
+
+            RoaringSet set;
+            uint64_t cardinality = 0;
+            const SnapshotContainerRecord* containers = reinterpret_cast<const SnapshotContainerRecord*>(base + record.containersOffset);
+            for (uint32_t c = 0; c < record.containerCount; c++)
+            {
+                const SnapshotContainerRecord& container = containers[c];
+                check(c == 0 || container.key > containers[c - 1].key, path);
+                check(container.cardinality >= 1 && container.cardinality <= 65536, path);
+
+                ContainerType type = static_cast<ContainerType>(container.type);
+                uint64_t bytes;
+                switch (type)
+                {
+                case ContainerType::Array:
+                    check(container.count == container.cardinality, path);
+                    bytes = container.count * sizeof(uint16_t);
+                    break;
+                case ContainerType::Bitmap:
+                    check(container.count == static_cast<uint32_t>(Container::ChunkBitmap::WordCount), path);
+                    bytes = sizeof(Container::ChunkBitmap);
+                    break;
+                case ContainerType::Run:
+                    check(container.count >= 1 && container.count <= 32768, path);
+                    bytes = container.count * sizeof(Run);
+                    break;
+                default:
+                    check(false, path);
+                    bytes = 0;
+                }
+                check(container.payloadOffset % payloadAlignment(type) == 0, path);
+                check(container.payloadOffset <= size && bytes <= size - container.payloadOffset, path);
+
+                // Контейнер ссылается на страницы отображения и продлевает его жизнь
+                set.appendContainer(container.key, Container::borrow(type, base + container.payloadOffset,
+                    static_cast<int>(container.count), static_cast<int>(container.cardinality), file));
+                cardinality += container.cardinality;
+            }
+            check(cardinality == record.cardinality, path);
+            std::string name(reinterpret_cast<const char*>(base + record.nameOffset), record.nameLength);
+            if (!SetRegistry::validName(name)) throw SnapshotError("недопустимое имя множества в файле " + path);
+            contents.sets.emplace_back(std::move(name), std::move(set));
+        }
+        return contents;
+    }
+};
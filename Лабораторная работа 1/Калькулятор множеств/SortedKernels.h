@@ -0,0 +1,273 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SORTED_KERNELS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "BitOps.h"
+
+// Ядра операций над отсортированными массивами без повторов.
+// Результат пишется в заранее выделенный буфер out, функции возвращают число записанных элементов.
+// Ёмкость out: для пересечения и разности - размер левого операнда, для объединения
+// и симметричной разности - сумма размеров.
+//
+// Пересечение массивов близкого размера сравнивает блоки по 128 бит инструкциями SSE2:
+// каждый элемент блока a сравнивается со всеми элементами блока b за несколько циклических
+// сдвигов. При сильно различающихся размерах меньший массив ищется в большем галопом
+// (экспоненциальный поиск от текущей позиции), что даёт O(m log(n/m)) вместо O(m + n).
+// Объединение и разности - слияния без ветвлений в теле цикла: сдвиг указателей
+// и запись вычисляются из результатов сравнения.
+
+// Начиная с какого отношения размеров пересечение переходит на галоп
+const size_t GallopRatio = 32;
+
+// Первая позиция в [from, size), где data[pos] >= value
+template <typename T>
+inline size_t gallop(const T* data, size_t from, size_t size, T value)
+{
+    if (from >= size || data[from] >= value) return from;
+    // Шагами 1, 2, 4, ... находим отрезок, содержащий ответ, затем двоичный поиск внутри него
+    size_t step = 1, low = from, high = from + 1;
+    while (high < size && data[high] < value)
+    {
+        low = high;
+        step <<= 1;
+        high = from + step;
+    }
+    if (high > size) high = size;
+    // data[low] < value, ответ в (low, high]
+    while (low + 1 < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (data[middle] < value) low = middle;
+        else high = middle;
+    }
+    return high;
+}
+
+template <typename T>
+inline size_t intersectGalloping(const T* small, size_t smallSize, const T* large, size_t largeSize, T* out)
+{
+    size_t count = 0, position = 0;
+    for (size_t i = 0; i < smallSize && position < largeSize; i++)
+    {
+        position = gallop(large, position, largeSize, small[i]);
+        if (position < largeSize && large[position] == small[i]) out[count++] = small[i];
+    }
+    return count;
+}
+
+// Скалярное пересечение слиянием с позиций i, j
+template <typename T>
+inline size_t intersectMerge(const T* a, size_t aSize, const T* b, size_t bSize, T* out, size_t i, size_t j, size_t count)
+{
+    while (i < aSize && j < bSize)
+    {
+        T x = a[i], y = b[j];
+        out[count] = x;
+        count += x == y;
+        i += x <= y;
+        j += y <= x;
+    }
+    return count;
+}
+
+#ifdef SORTED_KERNELS_SSE2
+// Блочное пересечение: a и b продвигаются блоками по 128 бит, пока хватает полных блоков
+inline size_t intersectBlocks(const int32_t* a, size_t aSize, const int32_t* b, size_t bSize, int32_t* out, size_t& i, size_t& j)
+{
+    size_t count = 0;
+    while (i + 4 <= aSize && j + 4 <= bSize)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        __m128i match = _mm_cmpeq_epi32(va, vb);
+        match = _mm_or_si128(match, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+        match = _mm_or_si128(match, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+        match = _mm_or_si128(match, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(match));
+        while (mask != 0)
+        {
+            out[count++] = a[i + lowestBit(static_cast<uint64_t>(mask))];
+            mask &= mask - 1;
+        }
+        int32_t lastA = a[i + 3], lastB = b[j + 3];
+        i += lastA <= lastB ? 4 : 0;
+        j += lastB <= lastA ? 4 : 0;
+    }
+    return count;
+}
+
+inline size_t intersectBlocks(const uint16_t* a, size_t aSize, const uint16_t* b, size_t bSize, uint16_t* out, size_t& i, size_t& j)
+{
+    size_t count = 0;
+    while (i + 8 <= aSize && j + 8 <= bSize)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        __m128i match = _mm_cmpeq_epi16(va, vb);
+        for (int rotation = 1; rotation < 8; rotation++)
+        {
+            // Циклический сдвиг блока b на одну позицию
+            vb = _mm_or_si128(_mm_srli_si128(vb, 2), _mm_slli_si128(vb, 14));
+            match = _mm_or_si128(match, _mm_cmpeq_epi16(va, vb));
+        }
+        // На каждый 16-битный элемент приходится два бита маски; берём чётные
+        int mask = _mm_movemask_epi8(match) & 0x5555;
+        while (mask != 0)
+        {
+            out[count++] = a[i + lowestBit(static_cast<uint64_t>(mask)) / 2];
+            mask &= mask - 1;
+        }
+        uint16_t lastA = a[i + 7], lastB = b[j + 7];
+        i += lastA <= lastB ? 8 : 0;
+        j += lastB <= lastA ? 8 : 0;
+    }
+    return count;
+}
+#endif
+
+// Для остальных типов блочного варианта нет: всё делает слияние
+template <typename T>
+inline size_t intersectBlocks(const T*, size_t, const T*, size_t, T*, size_t&, size_t&)
+{
+    return 0;
+}
+
+template <typename T>
+inline size_t intersectSorted(const T* a, size_t aSize, const T* b, size_t bSize, T* out)
+{
+    if (aSize == 0 || bSize == 0) return 0;
+    if (aSize * GallopRatio < bSize) return intersectGalloping(a, aSize, b, bSize, out);
+    if (bSize * GallopRatio < aSize) return intersectGalloping(b, bSize, a, aSize, out);
+
+    size_t i = 0, j = 0;
+    size_t count = intersectBlocks(a, aSize, b, bSize, out, i, j);
+    return intersectMerge(a, aSize, b, bSize, out, i, j, count);
+}
+
+template <typename T>
+inline size_t unionSorted(const T* a, size_t aSize, const T* b, size_t bSize, T* out)
+{
+    size_t i = 0, j = 0, count = 0;
+    while (i < aSize && j < bSize)
+    {
+        T x = a[i], y = b[j];
+        out[count++] = x < y ? x : y;
+        i += x <= y;
+        j += y <= x;
+    }
+    while (i < aSize) out[count++] = a[i++];
+    while (j < bSize) out[count++] = b[j++];
+    return count;
+}
+
+// Разность a - b; если b намного меньше, его элементы находятся галопом, а отрезки a между ними копируются
+template <typename T>
+inline size_t differenceSorted(const T* a, size_t aSize, const T* b, size_t bSize, T* out)
+{
+    size_t i = 0, j = 0, count = 0;
+    if (bSize * GallopRatio < aSize)
+    {
+        for (; j < bSize; j++)
+        {
+            size_t position = gallop(a, i, aSize, b[j]);
+            while (i < position) out[count++] = a[i++];
+            if (i < aSize && a[i] == b[j]) i++;
+        }
+        while (i < aSize) out[count++] = a[i++];
+        return count;
+    }
+
+    while (i < aSize && j < bSize)
+    {
+        T x = a[i], y = b[j];
+        out[count] = x;
+        count += x < y;
+        i += x <= y;
+        j += y <= x;
+    }
+    while (i < aSize) out[count++] = a[i++];
+    return count;
+}
+
+template <typename T>
+inline size_t symmetricDifferenceSorted(const T* a, size_t aSize, const T* b, size_t bSize, T* out)
+{
+    size_t i = 0, j = 0, count = 0;
+    while (i < aSize && j < bSize)
+    {
+        T x = a[i], y = b[j];
+        out[count] = x < y ? x : y;
+        count += x != y;
+        i += x <= y;
+        j += y <= x;
+    }
+    while (i < aSize) out[count++] = a[i++];
+    while (j < bSize) out[count++] = b[j++];
+    return count;
+}
+
+// Запросы без построения результата: мощность пересечения и проверки с выходом
+// на первом совпадении или первом контрпримере
+
+template <typename T>
+inline size_t intersectionCountSorted(const T* a, size_t aSize, const T* b, size_t bSize)
+{
+    if (aSize * GallopRatio < bSize || bSize * GallopRatio < aSize)
+    {
+        const T* small = aSize < bSize ? a : b;
+        const T* large = aSize < bSize ? b : a;
+        size_t smallSize = std::min(aSize, bSize), largeSize = std::max(aSize, bSize);
+        size_t count = 0, position = 0;
+        for (size_t i = 0; i < smallSize && position < largeSize; i++)
+        {
+            position = gallop(large, position, largeSize, small[i]);
+            count += position < largeSize && large[position] == small[i];
+        }
+        return count;
+    }
+
+    size_t i = 0, j = 0, count = 0;
+    while (i < aSize && j < bSize)
+    {
+        T x = a[i], y = b[j];
+        count += x == y;
+        i += x <= y;
+        j += y <= x;
+    }
+    return count;
+}
+
+template <typename T>
+inline bool intersectsSorted(const T* a, size_t aSize, const T* b, size_t bSize)
+{
+    size_t i = 0, j = 0;
+    while (i < aSize && j < bSize)
+    {
+        if (a[i] == b[j]) return true;
+        if (a[i] < b[j]) i = gallop(a, i, aSize, b[j]);
+        else j = gallop(b, j, bSize, a[i]);
+    }
+    return false;
+}
+
+// Все элементы a содержатся в b
+template <typename T>
+inline bool isSubsetSorted(const T* a, size_t aSize, const T* b, size_t bSize)
+{
+    if (aSize > bSize) return false;
+    size_t j = 0;
+    for (size_t i = 0; i < aSize; i++)
+    {
+        j = gallop(b, j, bSize, a[i]);
+        if (j == bSize || b[j] != a[i]) return false;
+        j++;
+    }
+    return true;
+}
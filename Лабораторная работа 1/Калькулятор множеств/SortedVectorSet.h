@@ -0,0 +1,124 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "SortedKernels.h"
+#include "RoaringSet.h"
+
+// Множество как отсортированный непрерывный массив чисел.
+// Для редких множеств в большом универсуме это самое компактное представление:
+// 4 байта на элемент без накладных расходов на блоки, указатели и узлы дерева.
+// Поиск - двоичный, операции - ядра SortedKernels.h (блочное сравнение SSE2, галоп, слияния без ветвлений).
+class SortedVectorSet
+{
+private:
+    std::vector<int> values;
+
+public:
+    SortedVectorSet()
+    {
+    }
+
+    // Множество из произвольного набора чисел (сортировка и удаление повторов)
+    static SortedVectorSet fromValues(std::vector<int> numbers)
+    {
+        std::sort(numbers.begin(), numbers.end());
+        numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+        SortedVectorSet result;
+        result.values = std::move(numbers);
+        return result;
+    }
+
+    static SortedVectorSet fromRoaring(const RoaringSet& set)
+    {
+        SortedVectorSet result;
+        result.values.reserve(static_cast<size_t>(set.size()));
+        set.forEach([&](int value) { result.values.push_back(value); });
+        return result;
+    }
+
+    // Перевод в блочное представление: подряд идущие значения одного блока собираются в контейнер за один проход
+    RoaringSet toRoaring() const
+    {
+        RoaringSet result;
+        size_t i = 0;
+        while (i < values.size())
+        {
+            uint32_t key = RoaringSet::toUnsigned(values[i]) >> 16;
+            std::vector<uint16_t> lows;
+            for (; i < values.size() && (RoaringSet::toUnsigned(values[i]) >> 16) == key; i++)
+            {
+                lows.push_back(static_cast<uint16_t>(RoaringSet::toUnsigned(values[i]) & 0xFFFF));
+            }
+            Container container = Container::fromArray(std::move(lows));
+            container.optimize();
+            result.appendContainer(static_cast<uint16_t>(key), std::move(container));
+        }
+        return result;
+    }
+
+    void clear()
+    {
+        values.clear();
+    }
+
+    bool empty() const
+    {
+        return values.empty();
+    }
+
+    uint64_t size() const
+    {
+        return values.size();
+    }
+
+    size_t memoryBytes() const
+    {
+        return values.capacity() * sizeof(int);
+    }
+
+    const std::vector<int>& elements() const
+    {
+        return values;
+    }
+
+    bool contains(int value) const
+    {
+        return std::binary_search(values.begin(), values.end(), value);
+    }
+
+    void add(int value)
+    {
+        auto it = std::lower_bound(values.begin(), values.end(), value);
+        if (it == values.end() || *it != value) values.insert(it, value);
+    }
+
+    template <typename Func>
+    void forEach(Func func) const
+    {
+        for (int value : values) func(value);
+    }
+
+    static SortedVectorSet combine(const SortedVectorSet& a, const SortedVectorSet& b, SetOperation op)
+    {
+        SortedVectorSet result;
+        result.values.resize(sortedResultCapacity(a.values.size(), b.values.size(), op));
+        size_t count = combineSorted(a.values.data(), a.values.size(), b.values.data(), b.values.size(), result.values.data(), op);
+        result.values.resize(count);
+        return result;
+    }
+
+    // Дополнение до отрезка [first, last]; результат может быть большим, если отрезок широк
+    SortedVectorSet complement(int first, int last) const
+    {
+        SortedVectorSet result;
+        auto it = std::lower_bound(values.begin(), values.end(), first);
+        for (long long value = first; value <= last; value++)
+        {
+            if (it != values.end() && *it == value) ++it;
+            else result.values.push_back(static_cast<int>(value));
+        }
+        return result;
+    }
+};
@@ -0,0 +1,169 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с перехватом задач (work stealing).
+// У каждого рабочего потока своя очередь: новые задачи он кладёт в её конец и берёт оттуда же,
+// а простаивающий поток забирает задачи с начала чужих очередей. Так потоки в основном работают
+// со своими (ещё горячими в кэше) задачами и не конкурируют за одну общую очередь.
+// Поток, ожидающий завершения parallelFor, сам выполняет задачи, поэтому вложенные
+// вызовы parallelFor из задач не приводят к взаимной блокировке.
+class ThreadPool
+{
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::atomic<size_t> queued;
+    std::atomic<size_t> nextQueue;
+    bool stopping;
+
+    // Номер очереди текущего потока в пуле owner (-1 для потоков вне пула)
+    struct CurrentWorker
+    {
+        const ThreadPool* owner;
+        int index;
+    };
+
+    static CurrentWorker& current()
+    {
+        static thread_local CurrentWorker worker = { nullptr, -1 };
+        return worker;
+    }
+
+    int ownIndex() const
+    {
+        return current().owner == this ? current().index : -1;
+    }
+
+    void push(std::function<void()> task)
+    {
+        int own = ownIndex();
+        size_t target = own >= 0 ? static_cast<size_t>(own) : nextQueue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> guard(queues[target]->lock);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    // Выполнение одной задачи: своей с конца очереди или чужой с начала
+    bool runOne()
+    {
+        int own = ownIndex();
+        std::function<void()> task;
+        if (own >= 0)
+        {
+            Queue& queue = *queues[own];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+        }
+        size_t start = own >= 0 ? static_cast<size_t>(own) + 1 : 0;
+        for (size_t k = 0; !task && k < queues.size(); k++)
+        {
+            Queue& victim = *queues[(start + k) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+        if (!task) return false;
+        queued--;
+        task();
+        return true;
+    }
+
+    void workerLoop(int index)
+    {
+        current() = { this, index };
+        while (true)
+        {
+            if (runOne()) continue;
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) return;
+        }
+    }
+
+public:
+    // threadCount = 0 - по числу аппаратных потоков
+    explicit ThreadPool(unsigned threadCount = 0)
+        : queued(0), nextQueue(0), stopping(false)
+    {
+        if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threadCount; i++) queues.emplace_back(new Queue());
+        for (unsigned i = 0; i < threadCount; i++) threads.emplace_back(&ThreadPool::workerLoop, this, static_cast<int>(i));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const
+    {
+        return threads.size();
+    }
+
+    // Вызов func(i) для всех i из [0, count) порциями по grain индексов; возвращается после завершения всех вызовов
+    template <typename Func>
+    void parallelFor(size_t count, size_t grain, Func func)
+    {
+        if (count == 0) return;
+        if (grain == 0) grain = 1;
+        if (count <= grain)
+        {
+            for (size_t i = 0; i < count; i++) func(i);
+            return;
+        }
+
+        std::atomic<size_t> remaining((count + grain - 1) / grain);
+        for (size_t begin = 0; begin < count; begin += grain)
+        {
+            size_t end = std::min(count, begin + grain);
+            push([&func, &remaining, begin, end]
+            {
+                for (size_t i = begin; i < end; i++) func(i);
+                remaining--;
+            });
+        }
+        // Пока порции не выполнены, ожидающий поток помогает пулу
+        while (remaining > 0)
+        {
+            if (!runOne()) std::this_thread::yield();
+        }
+    }
+};
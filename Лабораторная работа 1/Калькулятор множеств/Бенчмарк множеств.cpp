@@ -0,0 +1,533 @@
+﻿#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <clocale>
+#include <thread>
+#include "RoaringSet.h"
+#include "SortedVectorSet.h"
+#include "SetFormula.h"
+#include "FusedEvaluation.h"
+#include "ThreadPool.h"
+#include "ParallelSetOps.h"
+#include "SetSampler.h"
+#include "SetHandle.h"
+#include "BufferedWriter.h"
+
+using namespace std;
+
+// Микробенчмарк операций над множествами: объединение, пересечение, разность, симметричная разность,
+// дополнение и вычисление формулы в разных представлениях (RoaringSet, SortedVectorSet,
+// отложенное дополнение SetHandle, пооперационное и слитное вычисление формул).
+// Перебираются размер универсума, плотность, перекос (во сколько раз B меньше A) и число потоков.
+// Для каждого замера выводятся нс на операцию, число и объём выделений памяти на операцию
+// и затронутые байты (входы и результат) - в JSON или CSV для сравнения между сборками.
+
+// Счётчики выделений памяти: operator new заменён во всей программе, включая потоки пула.
+// Заменены все формы (обычная, nothrow, массивы, с выравниванием, с размером при освобождении),
+// иначе часть выделений прошла бы мимо счётчиков или освобождалась бы не той функцией
+static atomic<uint64_t> allocationCount(0);
+static atomic<uint64_t> allocatedBytes(0);
+
+// Выделение с подсчётом. Выравнивание больше стандартного - через _aligned_malloc или aligned_alloc
+// (у aligned_alloc размер должен быть кратен выравниванию), освобождение - парной функцией
+static void* countedAllocate(size_t size, size_t alignment) noexcept
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    allocatedBytes.fetch_add(size, memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) return malloc(size);
+#if _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+static void countedFree(void* memory, size_t alignment) noexcept
+{
+#if _WIN32
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) _aligned_free(memory);
+    else free(memory);
+#else
+    (void)alignment;    // Память от aligned_alloc освобождается через free
+    free(memory);
+#endif
+}
+
+static void* countedNew(size_t size, size_t alignment)
+{
+    void* memory = countedAllocate(size, alignment);
+    if (memory == nullptr) throw bad_alloc();
+    return memory;
+}
+
+void* operator new(size_t size)
+{
+    return countedNew(size, 0);
+}
+
+void* operator new[](size_t size)
+{
+    return countedNew(size, 0);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    return countedAllocate(size, 0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+    return countedAllocate(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment)
+{
+    return countedNew(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment)
+{
+    return countedNew(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept
+{
+    countedFree(memory, 0);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    countedFree(memory, 0);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    countedFree(memory, 0);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    countedFree(memory, 0);
+}
+
+void operator delete(void* memory, const nothrow_t&) noexcept
+{
+    countedFree(memory, 0);
+}
+
+void operator delete[](void* memory, const nothrow_t&) noexcept
+{
+    countedFree(memory, 0);
+}
+
+void operator delete(void* memory, align_val_t alignment) noexcept
+{
+    countedFree(memory, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void* memory, align_val_t alignment) noexcept
+{
+    countedFree(memory, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* memory, size_t, align_val_t alignment) noexcept
+{
+    countedFree(memory, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void* memory, size_t, align_val_t alignment) noexcept
+{
+    countedFree(memory, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* memory, align_val_t alignment, const nothrow_t&) noexcept
+{
+    countedFree(memory, static_cast<size_t>(alignment));
+}
+
+void operator delete[](void* memory, align_val_t alignment, const nothrow_t&) noexcept
+{
+    countedFree(memory, static_cast<size_t>(alignment));
+}
+
+// Результат одного замера
+struct Measurement
+{
+    string operation;           // union, intersection, difference, symmetric_difference, complement, formula
+    string variant;             // Представление или способ вычисления
+    uint64_t universe;
+    double density;
+    unsigned skew;
+    unsigned threads;
+    uint64_t iterations;
+    double nsPerOp;
+    double allocationsPerOp;
+    double allocatedBytesPerOp;
+    uint64_t bytesTouched;      // Память входов и результата
+    uint64_t resultSize;
+};
+
+// Параметры перебора (задаются в командной строке списками через запятую)
+struct BenchmarkOptions
+{
+    vector<uint64_t> universes = { 1u << 16, 1u << 20, 1u << 24 };
+    vector<double> densities = { 0.001, 0.01, 0.1, 0.5 };
+    vector<unsigned> skews = { 1, 16 };
+    vector<unsigned> threads = { 1, max(2u, thread::hardware_concurrency()) };
+    double minSeconds = 0.05;
+    uint64_t seed = 1;
+    bool csv = false;
+    string output;
+};
+
+// Дополнение отсортированного массива строится перебором универсума, поэтому только для небольших
+static const uint64_t SortedComplementLimit = 1u << 24;
+
+static const char* const operationNames[] = { "union", "intersection", "difference", "symmetric_difference" };
+static const SetOperation operations[] = { SetOperation::Union, SetOperation::Intersection, SetOperation::Difference, SetOperation::SymmetricDifference };
+
+// Формула для замеров: четыре операции и дополнение над тремя множествами
+static const char* const BenchmarkFormula = "(A+B)*!C-(A^B)";
+
+class SetBenchmark
+{
+private:
+    BenchmarkOptions options;
+    vector<Measurement> results;
+
+    // Замер operation(): прогон для описания результата, затем серии удваивающейся длины,
+    // пока общее время не превысит minSeconds. describe(результат) возвращает затронутые байты
+    template <typename Operation, typename Describe>
+    void measure(Measurement sample, Operation operation, Describe describe)
+    {
+        {
+            auto result = operation();
+            sample.resultSize = result.size();
+            sample.bytesTouched = describe(result);
+        }
+        uint64_t allocationsBefore = allocationCount.load();
+        uint64_t bytesBefore = allocatedBytes.load();
+        uint64_t iterations = 0, batch = 1;
+        auto start = chrono::steady_clock::now();
+        double elapsed = 0;
+        while (true)
+        {
+            for (uint64_t i = 0; i < batch; i++) operation();
+            iterations += batch;
+            elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (elapsed >= options.minSeconds) break;
+            batch *= 2;
+        }
+        sample.iterations = iterations;
+        sample.nsPerOp = elapsed * 1e9 / iterations;
+        sample.allocationsPerOp = static_cast<double>(allocationCount.load() - allocationsBefore) / iterations;
+        sample.allocatedBytesPerOp = static_cast<double>(allocatedBytes.load() - bytesBefore) / iterations;
+        results.push_back(sample);
+    }
+
+    // Замеры для одного сочетания параметров
+    void runCase(uint64_t universe, double density, unsigned skew, unsigned threads)
+    {
+        int last = static_cast<int>(universe - 1);
+        uint64_t countA = static_cast<uint64_t>(universe * density);
+        uint64_t countB = max<uint64_t>(1, countA / skew);
+        SetSampler sampler(options.seed);
+        const RoaringSet a = sampler.sample(countA, 0, last);
+        const RoaringSet b = sampler.sample(countB, 0, last);
+        const RoaringSet c = sampler.sample(countA, 0, last);
+        unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+
+        Measurement sample = Measurement();
+        sample.universe = universe;
+        sample.density = density;
+        sample.skew = skew;
+        sample.threads = threads;
+
+        size_t roaringInputs = a.memoryBytes() + b.memoryBytes();
+        auto roaringBytes = [&](const RoaringSet& result) { return roaringInputs + result.memoryBytes(); };
+        for (size_t i = 0; i < sizeof(operations) / sizeof(operations[0]); i++)
+        {
+            SetOperation op = operations[i];
+            sample.operation = operationNames[i];
+            sample.variant = "roaring";
+            if (pool)
+            {
+                measure(sample, [&]() { return ParallelSetOps::combine(*pool, a, b, op); }, roaringBytes);
+            }
+            else
+            {
+                measure(sample, [&]() { return RoaringSet::combine(a, b, op); }, roaringBytes);
+            }
+        }
+
+        // Однопоточные представления замеряются один раз на сочетание остальных параметров
+        if (threads == 1)
+        {
+            const SortedVectorSet sortedA = SortedVectorSet::fromRoaring(a);
+            const SortedVectorSet sortedB = SortedVectorSet::fromRoaring(b);
+            size_t sortedInputs = sortedA.memoryBytes() + sortedB.memoryBytes();
+            auto sortedBytes = [&](const SortedVectorSet& result) { return sortedInputs + result.memoryBytes(); };
+            for (size_t i = 0; i < sizeof(operations) / sizeof(operations[0]); i++)
+            {
+                SetOperation op = operations[i];
+                sample.operation = operationNames[i];
+                sample.variant = "sorted";
+                measure(sample, [&]() { return SortedVectorSet::combine(sortedA, sortedB, op); }, sortedBytes);
+            }
+
+            sample.operation = "complement";
+            sample.variant = "roaring";
+            measure(sample, [&]() { return a.complement(0, last); }, [&](const RoaringSet& result) { return a.memoryBytes() + result.memoryBytes(); });
+            if (universe <= SortedComplementLimit)
+            {
+                sample.variant = "sorted";
+                measure(sample, [&]() { return sortedA.complement(0, last); },
+                    [&](const SortedVectorSet& result) { return sortedA.memoryBytes() + result.memoryBytes(); });
+            }
+            // Отложенное дополнение: флаг на разделяемом множестве, элементы не строятся
+            SetHandle::SetPtr shared = make_shared<const RoaringSet>(a);
+            sample.variant = "lazy";
+            measure(sample, [&]() { return SetHandle(shared, 0, last).complement(); }, [&](const SetHandle&) { return a.memoryBytes(); });
+        }
+
+        const RoaringSet* operands[] = { &a, &b, &c };
+        Formula formula = Formula::compile(BenchmarkFormula, [](const string& name)
+        {
+            return name.size() == 1 && name[0] >= 'A' && name[0] <= 'C' ? name[0] - 'A' : -1;
+        });
+        const vector<FormulaInstruction>& program = formula.instructions();
+        auto setAt = [&](int index) -> const RoaringSet& { return *operands[index]; };
+        size_t formulaInputs = a.memoryBytes() + b.memoryBytes() + c.memoryBytes();
+        auto formulaBytes = [&](const RoaringSet& result) { return formulaInputs + result.memoryBytes(); };
+        sample.operation = "formula";
+        if (pool)
+        {
+            sample.variant = "fused";
+            measure(sample, [&]() { return ParallelSetOps::evaluate(*pool, program, setAt, 0, last); }, formulaBytes);
+        }
+        else
+        {
+            sample.variant = "stepwise";
+            measure(sample, [&]() { return formula.evaluateStepwise(setAt, 0, last); }, formulaBytes);
+            sample.variant = "fused";
+            measure(sample, [&]() { return FusedEvaluator::evaluate(program, setAt, 0, last); }, formulaBytes);
+        }
+    }
+
+    static void writeDouble(BufferedWriter& out, double value)
+    {
+        char text[32];
+        int length = snprintf(text, sizeof(text), "%.6g", value);
+        out.write(text, static_cast<size_t>(length));
+    }
+
+    void writeCsv(BufferedWriter& out) const
+    {
+        out.write("operation,variant,universe,density,skew,threads,iterations,ns_per_op,allocations_per_op,allocated_bytes_per_op,bytes_touched,result_size\n");
+        for (const Measurement& m : results)
+        {
+            out.write(m.operation);
+            out.write(',');
+            out.write(m.variant);
+            out.write(',');
+            out.writeInt(static_cast<long long>(m.universe));
+            out.write(',');
+            writeDouble(out, m.density);
+            out.write(',');
+            out.writeInt(m.skew);
+            out.write(',');
+            out.writeInt(m.threads);
+            out.write(',');
+            out.writeInt(static_cast<long long>(m.iterations));
+            out.write(',');
+            writeDouble(out, m.nsPerOp);
+            out.write(',');
+            writeDouble(out, m.allocationsPerOp);
+            out.write(',');
+            writeDouble(out, m.allocatedBytesPerOp);
+            out.write(',');
+            out.writeInt(static_cast<long long>(m.bytesTouched));
+            out.write(',');
+            out.writeInt(static_cast<long long>(m.resultSize));
+            out.write('\n');
+        }
+    }
+
+    void writeJson(BufferedWriter& out) const
+    {
+        out.write("{\n  \"formula\": \"");
+        out.write(BenchmarkFormula);
+        out.write("\",\n  \"results\": [");
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Measurement& m = results[i];
+            out.write(i == 0 ? "\n    {" : ",\n    {");
+            out.write("\"operation\": \"");
+            out.write(m.operation);
+            out.write("\", \"variant\": \"");
+            out.write(m.variant);
+            out.write("\", \"universe\": ");
+            out.writeInt(static_cast<long long>(m.universe));
+            out.write(", \"density\": ");
+            writeDouble(out, m.density);
+            out.write(", \"skew\": ");
+            out.writeInt(m.skew);
+            out.write(", \"threads\": ");
+            out.writeInt(m.threads);
+            out.write(", \"iterations\": ");
+            out.writeInt(static_cast<long long>(m.iterations));
+            out.write(", \"ns_per_op\": ");
+            writeDouble(out, m.nsPerOp);
+            out.write(", \"allocations_per_op\": ");
+            writeDouble(out, m.allocationsPerOp);
+            out.write(", \"allocated_bytes_per_op\": ");
+            writeDouble(out, m.allocatedBytesPerOp);
+            out.write(", \"bytes_touched\": ");
+            out.writeInt(static_cast<long long>(m.bytesTouched));
+            out.write(", \"result_size\": ");
+            out.writeInt(static_cast<long long>(m.resultSize));
+            out.write('}');
+        }
+        out.write("\n  ]\n}\n");
+    }
+
+public:
+    explicit SetBenchmark(const BenchmarkOptions& settings)
+        : options(settings)
+    {
+    }
+
+    void run()
+    {
+        for (uint64_t universe : options.universes)
+        {
+            for (double density : options.densities)
+            {
+                for (unsigned skew : options.skews)
+                {
+                    for (unsigned threads : options.threads) runCase(universe, density, skew, threads);
+                }
+            }
+        }
+    }
+
+    void write(BufferedWriter& out) const
+    {
+        if (options.csv) writeCsv(out);
+        else writeJson(out);
+    }
+};
+
+// Список значений через запятую; false, если значение не разобрано или не проходит проверку
+template <typename T, typename Valid>
+static bool parseList(const string& text, vector<T>& values, Valid valid)
+{
+    values.clear();
+    istringstream items(text);
+    string item;
+    while (getline(items, item, ','))
+    {
+        istringstream number(item);
+        T value;
+        if (!(number >> value) || !number.eof() || !valid(value)) return false;
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+static void printUsage()
+{
+    cerr << "Параметры (списки через запятую):" << endl;
+    cerr << "  --universe N1,N2,...   размеры универсума [0, N-1], N от 1 до 2^31" << endl;
+    cerr << "  --density D1,D2,...    доля универсума в множествах A и C, от 0 до 1" << endl;
+    cerr << "  --skew K1,K2,...       множество B в K раз меньше A" << endl;
+    cerr << "  --threads T1,T2,...    число потоков пула (1 - без пула)" << endl;
+    cerr << "  --min-time СЕКУНДЫ     минимальное время одного замера" << endl;
+    cerr << "  --seed N               зерно генератора множеств" << endl;
+    cerr << "  --format json|csv      формат результатов" << endl;
+    cerr << "  --output ФАЙЛ          запись результатов в файл вместо стандартного вывода" << endl;
+}
+
+static bool parseOptions(int argc, char* argv[], BenchmarkOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string name = argv[i];
+        if (i + 1 >= argc) return false;
+        string value = argv[++i];
+        bool valid = true;
+        if (name == "--universe") valid = parseList(value, options.universes, [](uint64_t n) { return n >= 1 && n <= (1ull << 31); });
+        else if (name == "--density") valid = parseList(value, options.densities, [](double d) { return d >= 0 && d <= 1; });
+        else if (name == "--skew") valid = parseList(value, options.skews, [](unsigned k) { return k >= 1; });
+        else if (name == "--threads") valid = parseList(value, options.threads, [](unsigned t) { return t >= 1 && t <= 256; });
+        else if (name == "--min-time")
+        {
+            istringstream number(value);
+            valid = static_cast<bool>(number >> options.minSeconds) && options.minSeconds > 0;
+        }
+        else if (name == "--seed")
+        {
+            istringstream number(value);
+            valid = static_cast<bool>(number >> options.seed);
+        }
+        else if (name == "--format")
+        {
+            valid = value == "json" || value == "csv";
+            options.csv = value == "csv";
+        }
+        else if (name == "--output") options.output = value;
+        else valid = false;
+        if (!valid) return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    setlocale(LC_ALL, "RU");
+    BenchmarkOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Файл открывается до замеров, чтобы ошибка не обнаружилась после долгого прогона
+    FILE* file = options.output.empty() ? stdout : openFile(options.output, "wb");
+    if (file == nullptr)
+    {
+        cerr << "Не удалось создать файл " << options.output << endl;
+        return 1;
+    }
+
+    SetBenchmark benchmark(options);
+    benchmark.run();
+    {
+        BufferedWriter out(file);
+        benchmark.write(out);
+    }
+    if (file != stdout && fclose(file) != 0)
+    {
+        cerr << "Ошибка записи в файл " << options.output << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,342 +1,876 @@
 ﻿#include <iostream>
 #include <vector>
-#include <set>
 #include <algorithm>
-#include <random>
 #include <string>
 #include <sstream>
+#include <fstream>
 #include <clocale>
+#include <climits>
+#include <limits>
+#include <unordered_map>
+#include "RoaringSet.h"
+#include "SetFormula.h"
+#include "FusedEvaluation.h"
+#include "FormulaSimplifier.h"
+#include "SetRegistry.h"
+#include "FormulaCache.h"
+#include "SetConditions.h"
+#include "BufferedWriter.h"
+#include "ThreadPool.h"
+#include "ParallelSetOps.h"
+#include "SetSampler.h"
+#include "SetSnapshot.h"
+#include "SetHandle.h"
+#include "SetEnumeration.h"
+#include "SetFormatter.h"
+#include "PersistentSet.h"
+#include "SetHistory.h"
+#include "Multiset.h"
 
 using namespace std;
 
+// Множество хранится в сжатых блоках по 2^16 элементов (см. RoaringSet.h)
+typedef RoaringSet UniverseSet;
+
 class SetCalculator
 {
 private:
-    vector<set<int>> sets;
-    set<int> universe;
+    SetRegistry sets;
+    ThreadPool pool;
+    FormulaCache cache;
+    SetSampler sampler;
+    SetFormat outputFormat;     // Запись множеств при выводе: списком или отрезками
+    SetHistory history;
+    unordered_map<string, Multiset> bags;   // Мультимножества: отдельные имена, в формулах не участвуют
+
+    // Границы универсума (включительно)
+    int universeMin;
+    int universeMax;
 
     // Вспомогательные функции
-    void initializeUniverse()
+    void initializeUniverse(int minValue, int maxValue)
     {
-        universe.clear();
-        for (int i = -50; i <= 50; i++)
-        {
-            universe.insert(i);
-        }
+        universeMin = minValue;
+        universeMax = maxValue;
     }
 
-    set<int> createSetFromConditions(const vector<pair<int, int>>& conditions)
+    // Количество элементов универсума
+    long long universeSize() const
     {
-        set<int> result;
-        for (int i = -50; i <= 50; i++)
+        return static_cast<long long>(universeMax) - universeMin + 1;
+    }
+
+    // Условия компилируются в генераторы масок и пересекаются пословно, без перебора чисел универсума
+    UniverseSet createSetFromConditions(const vector<SetCondition>& conditions)
+    {
+        return ConditionSetBuilder::build(conditions, universeMin, universeMax);
+    }
+
+    // Текстовое описание условия
+    static string describeCondition(const SetCondition& condition)
+    {
+        switch (condition.type)
         {
-            bool allConditionsMet = true;
+        case ConditionType::Parity:
+            return condition.first == 0 ? "Четные числа" : "Нечетные числа";
+        case ConditionType::Sign:
+            if (condition.first == 0) return "Положительные числа";
+            if (condition.first == 1) return "Отрицательные числа";
+            return "Ноль";
+        case ConditionType::Multiple:
+            return "Числа, кратные " + to_string(condition.first);
+        case ConditionType::Range:
+            return "Числа от " + to_string(condition.first) + " до " + to_string(condition.second);
+        case ConditionType::Residue:
+            return "Числа, дающие остаток " + to_string(condition.first) + " при делении на " + to_string(condition.second);
+        }
+        return "";
+    }
 
-            for (const auto& condition : conditions)
-            {
-                int conditionType = condition.first;
-                int n = condition.second;
-                bool conditionMet = false;
+    // Печать множества или отложенного дополнения (SetHandle) через буферизованный вывод:
+    // накопленный текст cout сбрасывается, элементы форматируются в буфер и выводятся блоками
+    template <typename Set>
+    void printSet(const Set& s, const string& name)
+    {
+        cout << flush;
+        BufferedWriter out(stdout);
+        writeSet(out, s, name);
+    }
 
-                switch (conditionType)
-                {
-                case 1: // Четность/нечетность
-                    if (n == 0) conditionMet = (i % 2 == 0); // Четные
-                    else conditionMet = (i % 2 != 0); // Нечетные
-                    break;
-                case 2: // Знак
-                    if (n == 0) conditionMet = (i > 0); // Положительные
-                    else if (n == 1) conditionMet = (i < 0); // Отрицательные
-                    else conditionMet = (i == 0); // Ноль
-                    break;
-                case 3: // Кратность
-                    if (n != 0) conditionMet = (i % n == 0);
-                    break;
-                }
+    template <typename Writer, typename Set>
+    void writeSet(Writer& out, const Set& s, const string& name)
+    {
+        out.write(name);
+        out.write(" = ", 3);
+        SetFormatter::writeElements(out, s, outputFormat);
+        out.write('\n');
+    }
 
-                if (!conditionMet)
-                {
-                    allConditionsMet = false;
-                    break;
-                }
+    // Запись множества в файл: list и intervals - текстом, binary - двоичной выгрузкой
+    void exportSet(int id, const string& path, const string& format)
+    {
+        SetFormat textFormat = SetFormat::List;
+        bool binary = format == "binary";
+        if (!binary && !parseSetFormat(format, textFormat))
+        {
+            throw FormulaError("неизвестный формат '" + format + "' (list, intervals, binary)", 0);
+        }
+        FILE* file = openFile(path, "wb");
+        if (file == nullptr) throw FormulaError("не удалось создать файл " + path, 0);
+        {
+            BufferedWriter out(file, 1 << 20);
+            if (binary)
+            {
+                SetFormatter::writeBinary(out, sets.at(id));
             }
-
-            if (allConditionsMet)
+            else
             {
-                result.insert(i);
+                SetFormatter::writeElements(out, sets.at(id), textFormat);
+                out.write('\n');
             }
         }
-        return result;
+        bool failed = ferror(file) != 0;
+        if (fclose(file) != 0 || failed) throw FormulaError("ошибка записи в файл " + path, 0);
     }
 
-    void printSet(const set<int>& s, const string& name)
+    // Строка сценария "set ИМЯ элементы...": элементы - числа или отрезки a..b
+    void batchDefineSet(istringstream& line, BufferedWriter& out)
     {
-        cout << name << " = {";
-        bool first = true;
-        for (int elem : s)
+        string name;
+        line >> name;
+        if (!SetRegistry::validName(name)) throw FormulaError("недопустимое имя множества '" + name + "'", 0);
+
+        // Отрезки собираются целиком и превращаются в множество за один проход
+        vector<pair<int, int>> ranges;
+        string item;
+        while (line >> item)
         {
-            if (!first) cout << ", ";
-            cout << elem;
-            first = false;
+            size_t dots = item.find("..");
+            long long first, last;
+            try
+            {
+                first = stoll(item.substr(0, dots));
+                last = dots == string::npos ? first : stoll(item.substr(dots + 2));
+            }
+            catch (const exception&)
+            {
+                throw FormulaError("не число: '" + item + "'", 0);
+            }
+            if (first > last || first < universeMin || last > universeMax)
+            {
+                throw FormulaError("элемент '" + item + "' вне универсума", 0);
+            }
+            ranges.push_back({ static_cast<int>(first), static_cast<int>(last) });
         }
-        cout << "}" << endl;
+        int id = sets.create(name);
+        storeSet(id, UniverseSet::fromRanges(std::move(ranges)));
+        writeSet(out, sets.at(id), name);
     }
 
-    // Самостоятельно реализованные операции над множествами
+    // Новое содержимое множества фиксируется как версия в истории (SetHistory.h). В реестре остаётся
+    // представление этой версии, поэтому следующая фиксация разделяет с ней все блоки, кроме изменённых
+    void storeSet(int id, UniverseSet&& value)
+    {
+        PersistentSet version = history.commit(sets.nameOf(id), std::move(value));
+        sets.modify(id) = version.view();
+    }
 
-    // Объединение множеств
-    set<int> setUnion(const set<int>& set1, const set<int>& set2)
+    // Снимок текущих версий всех множеств под меткой tag: копируются только указатели на версии
+    void takeSnapshot(const string& tag)
+    {
+        SetHistory::Snapshot contents;
+        for (int id : sets.ids()) contents.push_back({ sets.nameOf(id), history.current(sets.nameOf(id)) });
+        history.saveSnapshot(tag, std::move(contents));
+    }
+
+    // Восстановление множеств из снимка tag (множества, созданные после снимка, не меняются);
+    // возвращает число восстановленных множеств
+    size_t restoreSnapshot(const string& tag)
+    {
+        const SetHistory::Snapshot* contents = history.findSnapshot(tag);
+        if (contents == nullptr) throw FormulaError("снимок '" + tag + "' не найден", 0);
+        for (const auto& named : *contents) storeSet(sets.create(named.first), named.second.view());
+        return contents->size();
+    }
+
+    // Отмена последнего изменения множества; false, если отменять нечего
+    bool undoChange(int id)
+    {
+        const string& name = sets.nameOf(id);
+        if (!history.undo(name)) return false;
+        sets.modify(id) = history.current(name).view();
+        return true;
+    }
+
+    // Различия текущей версии множества с предыдущей (tag пуст) или с версией из снимка tag.
+    // Сравниваются только блоки, которые не разделяются версиями
+    template <typename Writer>
+    void writeDiff(Writer& out, int id, const string& tag)
     {
-        set<int> result;
-        // Добавляем все элементы из первого множества
-        for (int elem : set1)
+        const string& name = sets.nameOf(id);
+        PersistentSet before;
+        if (tag.empty())
         {
-            result.insert(elem);
+            if (!history.previous(name, before)) throw FormulaError("у множества '" + name + "' нет предыдущей версии", 0);
         }
-        // Добавляем все элементы из второго множества
-        for (int elem : set2)
+        else
         {
-            result.insert(elem);
+            const SetHistory::Snapshot* contents = history.findSnapshot(tag);
+            if (contents == nullptr) throw FormulaError("снимок '" + tag + "' не найден", 0);
+            auto it = find_if(contents->begin(), contents->end(), [&](const pair<string, PersistentSet>& named) { return named.first == name; });
+            if (it == contents->end()) throw FormulaError("множества '" + name + "' нет в снимке '" + tag + "'", 0);
+            before = it->second;
         }
-        return result;
+        UniverseSet added, removed;
+        PersistentSet::diff(before, history.current(name), added, removed);
+        out.write(name);
+        out.write(": добавлено ");
+        SetFormatter::writeElements(out, added, outputFormat);
+        out.write(", удалено ");
+        SetFormatter::writeElements(out, removed, outputFormat);
+        out.write('\n');
     }
 
-    // Пересечение множеств
-    set<int> setIntersection(const set<int>& set1, const set<int>& set2)
+    // Мультимножество в фигурных скобках: кратность k > 1 записывается как x:k, отрезок - a..b:k
+    template <typename Writer>
+    void writeBag(Writer& out, const Multiset& bag, const string& name)
     {
-        set<int> result;
-        // Проходим по меньшему множеству для оптимизации
-        const set<int>& smaller = (set1.size() <= set2.size()) ? set1 : set2;
-        const set<int>& larger = (set1.size() > set2.size()) ? set1 : set2;
-
-        for (int elem : smaller)
+        out.write(name);
+        out.write(" = {", 4);
+        bool leading = true;
+        bag.forEachRun([&](int from, int to, uint32_t count)
         {
-            if (larger.find(elem) != larger.end())
+            if (!leading) out.write(", ", 2);
+            leading = false;
+            out.writeInt(from);
+            if (to != from)
             {
-                result.insert(elem);
+                out.write("..", 2);
+                out.writeInt(to);
             }
+            if (count == 1) return;
+            out.write(':');
+            out.writeInt(count);
+        });
+        out.write("}, мощность ");
+        out.writeInt(bag.size());
+        out.write('\n');
+    }
+
+    const Multiset& findBag(const string& name) const
+    {
+        auto it = bags.find(name);
+        if (it == bags.end()) throw FormulaError("мультимножество '" + name + "' не найдено", 0);
+        return it->second;
+    }
+
+    // Мультимножество из элементов множества с кратностью 1. Если мультимножество с этим именем уже
+    // есть и построено над тем же универсумом, его хранилище переиспользуется без выделения памяти
+    const Multiset& bagFromSet(const string& name, int id)
+    {
+        if (!SetRegistry::validName(name)) throw FormulaError("недопустимое имя мультимножества '" + name + "'", 0);
+        auto it = bags.find(name);
+        if (it != bags.end() && it->second.minValue() == universeMin && it->second.maxValue() == universeMax)
+        {
+            it->second.assignSet(sets.at(id));
+            return it->second;
         }
-        return result;
+        return bags.insert_or_assign(name, Multiset::fromSet(sets.at(id), universeMin, universeMax)).first->second;
     }
 
-    // Разность множеств (set1 - set2)
-    set<int> setDifference(const set<int>& set1, const set<int>& set2)
+    // target = left op right; op: + - сумма, | - объединение (max), & - пересечение (min), - - разность (monus)
+    const Multiset& bagOperation(const string& target, const string& left, const string& op, const string& right)
+    {
+        if (!SetRegistry::validName(target)) throw FormulaError("недопустимое имя мультимножества '" + target + "'", 0);
+        BagOperation operation;
+        if (op == "+") operation = BagOperation::Sum;
+        else if (op == "|") operation = BagOperation::Max;
+        else if (op == "&") operation = BagOperation::Min;
+        else if (op == "-") operation = BagOperation::Monus;
+        else throw FormulaError("неизвестная операция '" + op + "' (+, |, &, -)", 0);
+        Multiset result = Multiset::combine(findBag(left), findBag(right), operation);
+        return bags.insert_or_assign(target, std::move(result)).first->second;
+    }
+
+    // Множество элементов мультимножества с ненулевой кратностью
+    int setFromBag(const string& name, const string& bagName)
     {
-        set<int> result;
-        // Добавляем элементы из set1, которых нет в set2
-        for (int elem : set1)
+        if (!SetRegistry::validName(name)) throw FormulaError("недопустимое имя множества '" + name + "'", 0);
+        UniverseSet support = findBag(bagName).support();
+        int id = sets.create(name);
+        storeSet(id, std::move(support));
+        return id;
+    }
+
+    // Строка сценария "bag ИМЯ элементы..." (числа и отрезки a..b с необязательной кратностью :k)
+    // или "bag ИМЯ = X ОП Y"
+    void batchDefineBag(istringstream& line, BufferedWriter& out)
+    {
+        string name, item;
+        line >> name;
+        if (!SetRegistry::validName(name)) throw FormulaError("недопустимое имя мультимножества '" + name + "'", 0);
+        if (line >> item && item == "=")
+        {
+            string left, op, right;
+            if (!(line >> left >> op >> right)) throw FormulaError("ожидалось: bag ИМЯ = X ОП Y", 0);
+            writeBag(out, bagOperation(name, left, op, right), name);
+            return;
+        }
+
+        Multiset defined(universeMin, universeMax);
+        for (bool more = !item.empty(); more; more = static_cast<bool>(line >> item))
         {
-            if (set2.find(elem) == set2.end())
+            size_t colon = item.find(':');
+            size_t dots = item.find("..");
+            long long first, last, count = 1;
+            try
+            {
+                first = stoll(item.substr(0, min(dots, colon)));
+                last = dots == string::npos ? first : stoll(item.substr(dots + 2, colon == string::npos ? string::npos : colon - dots - 2));
+                if (colon != string::npos) count = stoll(item.substr(colon + 1));
+            }
+            catch (const exception&)
+            {
+                throw FormulaError("не число: '" + item + "'", 0);
+            }
+            if (first > last || first < universeMin || last > universeMax)
             {
-                result.insert(elem);
+                throw FormulaError("элемент '" + item + "' вне универсума", 0);
             }
+            if (count < 1 || count > UINT32_MAX) throw FormulaError("кратность в '" + item + "' должна быть от 1 до 2^32-1", 0);
+            defined.addRange(static_cast<int>(first), static_cast<int>(last), static_cast<uint32_t>(count));
         }
-        return result;
+        writeBag(out, bags.insert_or_assign(name, std::move(defined)).first->second, name);
     }
 
-    // Симметричная разность
-    set<int> setSymmetricDifference(const set<int>& set1, const set<int>& set2)
+    // Запись всех множеств и границ универсума в двоичный снимок
+    void saveSnapshot(const string& path) const
+    {
+        vector<pair<string, const UniverseSet*>> named;
+        for (int id : sets.ids()) named.push_back({ sets.nameOf(id), &sets.at(id) });
+        SetSnapshot::save(path, named, universeMin, universeMax);
+    }
+
+    // Загрузка снимка: границы универсума берутся из снимка, одноимённые множества заменяются.
+    // Данные множеств остаются в отображённом файле и не копируются; возвращает число множеств
+    size_t loadSnapshot(const string& path)
     {
-        set<int> result;
+        SetSnapshot::Contents contents = SetSnapshot::load(path);
+        initializeUniverse(contents.universeMin, contents.universeMax);
+        for (auto& named : contents.sets)
+        {
+            storeSet(sets.create(named.first), std::move(named.second));
+        }
+        return contents.sets.size();
+    }
 
-        // Элементы из set1, которых нет в set2
-        for (int elem : set1)
+    // Строка сценария "random ИМЯ K [N]"
+    void batchRandomSets(istringstream& line, BufferedWriter& out)
+    {
+        string name;
+        long long count, copies = 0;
+        line >> name;
+        if (!SetRegistry::validName(name)) throw FormulaError("недопустимое имя множества '" + name + "'", 0);
+        if (!(line >> count) || count < 0) throw FormulaError("ожидалось число элементов K >= 0", 0);
+        if (count > universeSize()) throw FormulaError("в универсуме меньше " + to_string(count) + " чисел", 0);
+        if (!(line >> copies))
         {
-            if (set2.find(elem) == set2.end())
-            {
-                result.insert(elem);
-            }
+            int id = sets.create(name);
+            storeSet(id, sampler.sample(static_cast<uint64_t>(count), universeMin, universeMax));
+            writeSet(out, sets.at(id), name);
+            return;
         }
+        if (copies <= 0) throw FormulaError("ожидалось число множеств N > 0", 0);
 
-        // Элементы из set2, которых нет в set1
-        for (int elem : set2)
+        vector<UniverseSet> generated = SetSampler::sampleMany(pool, static_cast<size_t>(copies), static_cast<uint64_t>(count),
+            universeMin, universeMax, sampler.nextSeed());
+        for (size_t i = 0; i < generated.size(); i++)
+        {
+            storeSet(sets.create(name + to_string(i + 1)), std::move(generated[i]));
+        }
+        out.write(name);
+        out.write("1..", 3);
+        out.write(name);
+        out.writeInt(copies);
+        out.write(": ", 2);
+        out.writeInt(copies);
+        out.write(" случайных множеств по ");
+        out.writeInt(count);
+        out.write(" элементов\n");
+    }
+
+    // Сколько элементов перебора форматирует одна задача пула
+    static const uint64_t EnumerationGrain = 4096;
+
+    // Вывод ленивого перебора (SetEnumeration.h) по одному элементу в строке.
+    // Номера делятся на окна, окно - на отрезки, которые форматируются в строки параллельно
+    // и печатаются по порядку; в памяти одновременно только текст одного окна
+    template <typename Enumerator, typename Format>
+    void writeEnumeration(BufferedWriter& out, const Enumerator& items, Format format)
+    {
+        size_t parts = pool.size() * 4;
+        uint64_t window = EnumerationGrain * parts;
+        vector<StringWriter> texts(parts);
+        uint64_t total = items.size();
+        for (uint64_t begin = 0; begin < total; )
         {
-            if (set1.find(elem) == set1.end())
+            uint64_t end = total - begin > window ? begin + window : total;
+            size_t used = static_cast<size_t>(min<uint64_t>(parts, (end - begin + EnumerationGrain - 1) / EnumerationGrain));
+            forEachRangeParallel(pool, begin, end, used, [&](size_t part, uint64_t from, uint64_t to)
             {
-                result.insert(elem);
+                StringWriter& text = texts[part];
+                items.forRange(from, to, [&](const typename Enumerator::Item& item) { format(text, item); });
+            });
+            for (size_t p = 0; p < used; p++)
+            {
+                out.write(texts[p].str());
+                texts[p] = StringWriter();
             }
+            begin = end;
         }
+    }
 
-        return result;
+    // Все подмножества множества (k < 0) или подмножества из k элементов
+    void writeSubsets(BufferedWriter& out, int id, long long k)
+    {
+        const UniverseSet& set = sets.at(id);
+        if (!MaskedElements::fits(set)) throw FormulaError("в множестве больше 63 элементов", 0);
+        const string& name = sets.nameOf(id);
+        auto format = [](const MaskedElements& elements)
+        {
+            return [&elements](StringWriter& text, uint64_t mask)
+            {
+                text.write('{');
+                bool first = true;
+                elements.forEachElement(mask, [&](int value)
+                {
+                    if (!first) text.write(", ", 2);
+                    text.writeInt(value);
+                    first = false;
+                });
+                text.write("}\n", 2);
+            };
+        };
+        if (k < 0)
+        {
+            PowerSetEnumerator subsets(set);
+            out.write("P(" + name + "): ");
+            out.write(to_string(subsets.size()));
+            out.write(" подмножеств\n");
+            writeEnumeration(out, subsets, format(subsets));
+            return;
+        }
+        CombinationEnumerator subsets(set, static_cast<int>(min<long long>(k, MaskedElements::MaxElements + 1)));
+        out.write("Подмножества " + name + " из ");
+        out.writeInt(k);
+        out.write(" элементов: ");
+        out.write(to_string(subsets.size()));
+        out.write('\n');
+        writeEnumeration(out, subsets, format(subsets));
     }
 
-    // Дополнение множества (до универсума) 
-    set<int> setComplement(const set<int>& set1)
+    // Декартово произведение множеств ids[0] x ids[1] x ...
+    void writeProduct(BufferedWriter& out, const vector<int>& ids)
     {
-        set<int> result;
+        vector<const UniverseSet*> factors;
+        string title;
+        for (int id : ids)
+        {
+            factors.push_back(&sets.at(id));
+            title += (title.empty() ? "" : " x ") + sets.nameOf(id);
+        }
+        if (!ProductEnumerator::fits(factors))
+        {
+            throw FormulaError("ожидалось от 1 до " + to_string(ProductEnumerator::MaxFactors) + " множеств и не больше 2^64 кортежей", 0);
+        }
+        ProductEnumerator product(factors);
+        out.write(title + ": ");
+        out.write(to_string(product.size()));
+        out.write(" кортежей\n");
+        int width = product.width();
+        writeEnumeration(out, product, [width](StringWriter& text, const int* tuple)
+        {
+            text.write('(');
+            for (int i = 0; i < width; i++)
+            {
+                if (i > 0) text.write(", ", 2);
+                text.writeInt(tuple[i]);
+            }
+            text.write(")\n", 2);
+        });
+    }
 
-        // Проходим по всем элементам универсума
-        for (int elem : universe)
+    // Строки сценария "subsets ИМЯ [K]" и "product ИМЯ1 ИМЯ2 ..."
+    void batchEnumeration(const string& command, istringstream& line, BufferedWriter& out)
+    {
+        vector<int> ids;
+        string item;
+        long long k = -1;
+        while (line >> item)
         {
-            // Если элемента нет в исходном множестве, добавляем его в результат
-            if (set1.find(elem) == set1.end())
+            if (command == "subsets" && !ids.empty())
             {
-                result.insert(elem);
+                try
+                {
+                    k = stoll(item);
+                }
+                catch (const exception&)
+                {
+                    throw FormulaError("не число: '" + item + "'", 0);
+                }
+                if (k < 0) throw FormulaError("ожидалось число элементов K >= 0", 0);
+                break;
             }
+            int id = sets.find(item);
+            if (id < 0) throw FormulaError("множество '" + item + "' не найдено", 0);
+            ids.push_back(id);
         }
-
-        return result;
+        if (ids.empty()) throw FormulaError("ожидалось имя множества", 0);
+        if (command == "subsets") writeSubsets(out, ids[0], k);
+        else writeProduct(out, ids);
     }
 
-    set<int> evaluateFormula(const string& formula)
+    template <typename Writer>
+    static void writeBatchError(Writer& out, long long lineNumber, const FormulaError& error)
     {
-        // Упрощенный парсинг формул без вложенных скобок
-        // Формат: A+B, A*B, A-B, A^B, !A
-
-        if (formula.empty()) return set<int>();
+        out.write("Ошибка (строка ");
+        out.writeInt(lineNumber);
+        out.write("): ");
+        out.write(error.what());
+        out.write('\n');
+    }
 
-        // Проверяем унарные операции
-        if (formula[0] == '!')
+    // Строка пакета с формулой без присваивания; после вычисления text заменяется выводом
+    struct BatchLine
+    {
+        long long number;
+        string text;
+        bool failed;
+    };
+
+    // Сколько формул накапливается перед параллельным вычислением и сколько строк берёт одна задача
+    static const size_t BatchBlockLines = 4096;
+    static const size_t BatchGrain = 16;
+
+    // Вычисление накопленных формул. Они не зависят друг от друга и только читают множества
+    // реестра, поэтому распределяются по потокам пула без копирования множеств; кэш формул
+    // общий для всех потоков. Выводы собираются в строки и печатаются в исходном порядке.
+    // Возвращает число ошибок.
+    int flushBatch(vector<BatchLine>& lines, BufferedWriter& out)
+    {
+        pool.parallelFor(lines.size(), BatchGrain, [&](size_t i)
         {
-            char setChar = formula[1];
-            int setIndex = setChar - 'A';
-            if (setIndex >= 0 && setIndex < sets.size())
+            BatchLine& line = lines[i];
+            StringWriter text;
+            try
+            {
+                writeQueryAnswer(text, compileFormulaQuery(line.text), line.text);
+                line.failed = false;
+            }
+            catch (const FormulaError& error)
             {
-                return setComplement(sets[setIndex]);
+                writeBatchError(text, line.number, error);
+                line.failed = true;
             }
+            line.text = text.str();
+        });
+
+        int errors = 0;
+        for (const BatchLine& line : lines)
+        {
+            out.write(line.text);
+            if (line.failed) errors++;
         }
+        lines.clear();
+        return errors;
+    }
+
+    // Самостоятельно реализованные операции над множествами
+
+    // Объединение множеств
+    UniverseSet setUnion(const UniverseSet& set1, const UniverseSet& set2)
+    {
+        // Блоки без пары копируются, общие блоки сливаются ядром для своей пары контейнеров
+        return ParallelSetOps::combine(pool, set1, set2, SetOperation::Union);
+    }
+
+    // Пересечение множеств
+    UniverseSet setIntersection(const UniverseSet& set1, const UniverseSet& set2)
+    {
+        // Обрабатываются только блоки, присутствующие в обоих множествах
+        return ParallelSetOps::combine(pool, set1, set2, SetOperation::Intersection);
+    }
+
+    // Разность множеств (set1 - set2)
+    UniverseSet setDifference(const UniverseSet& set1, const UniverseSet& set2)
+    {
+        // Блоки set1 без пары в set2 переходят в результат целиком
+        return ParallelSetOps::combine(pool, set1, set2, SetOperation::Difference);
+    }
+
+    // Симметричная разность
+    UniverseSet setSymmetricDifference(const UniverseSet& set1, const UniverseSet& set2)
+    {
+        return ParallelSetOps::combine(pool, set1, set2, SetOperation::SymmetricDifference);
+    }
+
+    // Дополнение множества (до универсума) за O(1): множество не копируется, дополнение
+    // остаётся флагом и перечисляется по промежуткам между элементами set1
+    SetHandle setComplement(const UniverseSet& set1)
+    {
+        return SetHandle::complementOf(SetHandle::SetPtr(SetHandle::SetPtr(), &set1), universeMin, universeMax);
+    }
+
+    // Запросы без построения результата
+
+    // Мощность пересечения: подсчёт по блокам без создания множества
+    uint64_t setIntersectionSize(const UniverseSet& set1, const UniverseSet& set2)
+    {
+        return UniverseSet::intersectionSize(set1, set2);
+    }
+
+    // set1 - подмножество set2; проверка прекращается на первом элементе set1, которого нет в set2
+    bool isSubset(const UniverseSet& set1, const UniverseSet& set2)
+    {
+        return UniverseSet::isSubset(set1, set2);
+    }
+
+    // Множества не пересекаются; проверка прекращается на первом общем элементе
+    bool areDisjoint(const UniverseSet& set1, const UniverseSet& set2)
+    {
+        return !UniverseSet::intersects(set1, set2);
+    }
 
-        // Бинарные операции
-        for (size_t i = 1; i < formula.length() - 1; i++)
+    // Позиция '=' присваивания "ИМЯ = формула" или npos; знаки отношений <=, >=, == присваиванием не считаются
+    static size_t findAssignment(const string& line)
+    {
+        for (size_t i = 0; i < line.size(); i++)
         {
-            char op = formula[i];
-            if (op == '+' || op == '*' || op == '-' || op == '^')
-            {
-                char leftChar = formula[i - 1];
-                char rightChar = formula[i + 1];
+            if (line[i] != '=') continue;
+            bool partOfRelation = (i > 0 && (line[i - 1] == '<' || line[i - 1] == '>' || line[i - 1] == '='))
+                || (i + 1 < line.size() && line[i + 1] == '=');
+            if (!partOfRelation) return i;
+            i++;
+        }
+        return string::npos;
+    }
 
-                int leftIndex = leftChar - 'A';
-                int rightIndex = rightChar - 'A';
+    // Идентификатор множества по имени или -1
+    int findSet(const string& name) const
+    {
+        return sets.find(name);
+    }
 
-                if (leftIndex >= 0 && leftIndex < sets.size() &&
-                    rightIndex >= 0 && rightIndex < sets.size())
-                {
+    // Чтение имени существующего множества; при ошибке возвращает -1
+    int readSet()
+    {
+        string name;
+        cin >> name;
+        int id = sets.find(name);
+        if (id < 0) cout << "Множество '" << name << "' не найдено." << endl;
+        return id;
+    }
 
-                    set<int> result;
-                    switch (op)
-                    {
-                    case '+': // Объединение
-                        result = setUnion(sets[leftIndex], sets[rightIndex]);
-                        break;
-                    case '*': // Пересечение
-                        result = setIntersection(sets[leftIndex], sets[rightIndex]);
-                        break;
-                    case '-': // Разность
-                        result = setDifference(sets[leftIndex], sets[rightIndex]);
-                        break;
-                    case '^': // Симметричная разность
-                        result = setSymmetricDifference(sets[leftIndex], sets[rightIndex]);
-                        break;
-                    }
-                    return result;
-                }
-            }
+    // Разбор запроса (формула, |формула| или отношение двух формул); при синтаксической ошибке бросает FormulaError
+    FormulaQuery parseQuery(const string& text) const
+    {
+        return compileQuery(text, [this](const string& name) { return findSet(name); });
+    }
+
+    // Упрощение формулы; правила с универсумом применяются только к множествам, лежащим в нём
+    Formula simplifyFormula(const Formula& formula) const
+    {
+        return FormulaSimplifier::simplify(formula, [this](int id) { return sets.at(id).within(universeMin, universeMax); });
+    }
+
+    void simplifyQuery(FormulaQuery& query) const
+    {
+        query.left = simplifyFormula(query.left);
+        if (query.type != QueryType::Value && query.type != QueryType::Count) query.right = simplifyFormula(query.right);
+    }
+
+    // Разбор и упрощение формул запроса перед вычислением
+    FormulaQuery compileFormulaQuery(const string& text) const
+    {
+        FormulaQuery query = parseQuery(text);
+        simplifyQuery(query);
+        return query;
+    }
+
+    // Ответ на запрос: множество, мощность или "да"/"нет" для отношения
+    template <typename Writer>
+    void writeQueryAnswer(Writer& out, const FormulaQuery& query, const string& text)
+    {
+        if (query.type == QueryType::Value)
+        {
+            writeSet(out, evaluateFormula(query.left), text);
+            return;
         }
+        out.write(text);
+        if (query.type == QueryType::Count)
+        {
+            out.write(" = ");
+            out.writeInt(static_cast<long long>(cache.count(query.left, sets, universeMin, universeMax)));
+            out.write('\n');
+            return;
+        }
+
+        // Отношения с дополнениями проверяются по базовым множествам, без построения дополнений
+        SetHandle left = evaluateFormula(query.left);
+        SetHandle right = evaluateFormula(query.right);
+        bool answer = false;
+        switch (query.type)
+        {
+        case QueryType::Subset: answer = SetHandle::isSubset(left, right); break;
+        case QueryType::Superset: answer = SetHandle::isSubset(right, left); break;
+        case QueryType::Equal: answer = SetHandle::equals(left, right); break;
+        case QueryType::Disjoint: answer = SetHandle::disjoint(left, right); break;
+        default: break;
+        }
+        out.write(answer ? ": да\n" : ": нет\n");
+    }
 
-        return set<int>();
+    // Результат берётся из кэша, если ни одно из входящих в формулу множеств не изменилось;
+    // формулы из нескольких операций вычисляются за один проход без промежуточных множеств,
+    // а дополнение результата строится только при перечислении его элементов
+    SetHandle evaluateFormula(const Formula& formula)
+    {
+        return cache.evaluateHandle(formula, sets, universeMin, universeMax);
     }
 
 public:
-    SetCalculator()
+    SetCalculator(int minValue = -50, int maxValue = 50)
+        : cache(FormulaCache::DefaultBudget, &pool), sampler(SetSampler::randomSeed()), outputFormat(SetFormat::List)
     {
-        sets.resize(3);
-        initializeUniverse();
+        sets.create("A");
+        sets.create("B");
+        sets.create("C");
+        initializeUniverse(minValue, maxValue);
+    }
+
+    void configureUniverse()
+    {
+        cout << "Универсум: [" << universeMin << ", " << universeMax << "]. Изменить? (1 - да, 0 - нет): ";
+        int answer;
+        cin >> answer;
+        if (answer != 1) return;
+
+        while (true)
+        {
+            long long minValue, maxValue;
+            cout << "Введите границы универсума (min max): ";
+            cin >> minValue >> maxValue;
+            if (minValue <= maxValue && minValue >= INT_MIN && maxValue <= INT_MAX)
+            {
+                initializeUniverse(static_cast<int>(minValue), static_cast<int>(maxValue));
+                break;
+            }
+            cout << "Границы должны быть 32-битными целыми и min <= max. Попробуйте снова." << endl;
+        }
     }
 
     void createSets()
     {
         cout << "=== СОЗДАНИЕ МНОЖЕСТВ ===" << endl;
 
-        for (int i = 0; i < 3; i++)
+        for (int id : sets.ids())
         {
-            cout << "\n--- Создание множества " << char('A' + i) << " ---" << endl;
-            cout << "Выберите способ создания:" << endl;
-            cout << "1. Ручной ввод" << endl;
-            cout << "2. Генератор случайных чисел" << endl;
-            cout << "3. Заполнение по условию" << endl;
+            cout << "\n--- Создание множества " << sets.nameOf(id) << " ---" << endl;
+            fillSet(id);
+        }
+    }
 
-            int choice;
-            cin >> choice;
+    // Выбор способа заполнения множества и его вывод
+    void fillSet(int id)
+    {
+        cout << "Выберите способ создания:" << endl;
+        cout << "1. Ручной ввод" << endl;
+        cout << "2. Генератор случайных чисел" << endl;
+        cout << "3. Заполнение по условию" << endl;
 
-            switch (choice)
-            {
-            case 1:
-            {
-                manualInput(i);
-                break;
-            }
-            case 2:
-            {
-                randomGeneration(i);
-                break;
-            }
-            case 3:
-            {
-                conditionalInput(i);
-                break;
-            }
-            default:
-            {
-                cout << "Неверный выбор, используется ручной ввод." << endl;
-                manualInput(i);
-                break;
-            }
-            }
+        int choice;
+        cin >> choice;
 
-            // Вывод созданного множества
-            printSet(sets[i], string(1, 'A' + i));
+        switch (choice)
+        {
+        case 1:
+        {
+            manualInput(id);
+            break;
         }
+        case 2:
+        {
+            randomGeneration(id);
+            break;
+        }
+        case 3:
+        {
+            conditionalInput(id);
+            break;
+        }
+        default:
+        {
+            cout << "Неверный выбор, используется ручной ввод." << endl;
+            manualInput(id);
+            break;
+        }
+        }
+
+        // Заполненное множество становится новой версией в истории
+        storeSet(id, std::move(sets.modify(id)));
+
+        // Вывод созданного множества
+        printSet(sets.at(id), sets.nameOf(id));
     }
 
     void manualInput(int setIndex)
     {
-        cout << "Введите 10 уникальных целых чисел от -50 до 50:" << endl;
-        sets[setIndex].clear();
+        long long count = min(10LL, universeSize());
+        cout << "Введите " << count << " уникальных целых чисел от " << universeMin << " до " << universeMax << ":" << endl;
+        sets.modify(setIndex).clear();
 
-        for (int j = 0; j < 10; j++)
+        for (int j = 0; j < count; j++)
         {
             int num;
             cout << "Число " << (j + 1) << ": ";
             cin >> num;
 
-            if (num < -50 || num > 50)
+            if (num < universeMin || num > universeMax)
             {
-                cout << "Число должно быть в диапазоне [-50, 50]. Попробуйте снова." << endl;
+                cout << "Число должно быть в диапазоне [" << universeMin << ", " << universeMax << "]. Попробуйте снова." << endl;
                 j--;
                 continue;
             }
 
-            if (sets[setIndex].count(num) > 0)
+            if (sets.at(setIndex).contains(num))
             {
                 cout << "Это число уже есть в множестве. Попробуйте снова." << endl;
                 j--;
                 continue;
             }
 
-            sets[setIndex].insert(num);
+            sets.modify(setIndex).add(num);
         }
     }
 
     void randomGeneration(int setIndex)
     {
-        random_device rd;
-        mt19937 gen(rd());
-        uniform_int_distribution<> dis(-50, 50);
-
-        sets[setIndex].clear();
-
-        while (sets[setIndex].size() < 10)
+        long long count;
+        cout << "Сколько чисел выбрать (от 0 до " << universeSize() << "): ";
+        while (!(cin >> count) || count < 0 || count > universeSize())
         {
-            int num = dis(gen);
-            sets[setIndex].insert(num);
+            if (!cin) cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Введите число от 0 до " << universeSize() << ": ";
         }
+        sets.modify(setIndex) = sampler.sample(static_cast<uint64_t>(count), universeMin, universeMax);
 
         cout << "Множество заполнено случайными числами." << endl;
     }
 
     void conditionalInput(int setIndex)
     {
-        vector<pair<int, int>> conditions;
+        vector<SetCondition> conditions;
 
         cout << "=== ВЫБОР УСЛОВИЙ ДЛЯ МНОЖЕСТВА ===" << endl;
 
@@ -359,40 +893,55 @@ public:
                 cout << "1. Четность/нечетность" << endl;
                 cout << "2. Знак (+ или -)" << endl;
                 cout << "3. Кратность числу" << endl;
+                cout << "4. Диапазон [от, до]" << endl;
+                cout << "5. Остаток от деления" << endl;
 
                 int conditionType;
                 cin >> conditionType;
 
-                int param = 0;
+                SetCondition condition{ static_cast<ConditionType>(conditionType), 0, 0 };
                 if (conditionType == 1)
                 {
                     cout << "Выберите: 0 - четные, 1 - нечетные: ";
-                    cin >> param;
-                    conditions.push_back({ conditionType, param });
-                    cout << "Добавлено условие: " << (param == 0 ? "четные" : "нечетные") << " числа" << endl;
+                    cin >> condition.first;
                 }
                 else if (conditionType == 2)
                 {
                     cout << "Выберите: 0 - положительные, 1 - отрицательные, 2 - ноль: ";
-                    cin >> param;
-                    conditions.push_back({ conditionType, param });
-                    string signDesc;
-                    if (param == 0) signDesc = "положительные";
-                    else if (param == 1) signDesc = "отрицательные";
-                    else signDesc = "ноль";
-                    cout << "Добавлено условие: " << signDesc << " числа" << endl;
+                    cin >> condition.first;
                 }
                 else if (conditionType == 3)
                 {
                     cout << "Введите число для проверки кратности: ";
-                    cin >> param;
-                    conditions.push_back({ conditionType, param });
-                    cout << "Добавлено условие: числа, кратные " << param << endl;
+                    cin >> condition.first;
+                }
+                else if (conditionType == 4)
+                {
+                    cout << "Введите границы диапазона (от до): ";
+                    cin >> condition.first >> condition.second;
+                }
+                else if (conditionType == 5)
+                {
+                    cout << "Введите остаток и делитель (делитель > 0, 0 <= остаток < делителя): ";
+                    cin >> condition.first >> condition.second;
+                    if (condition.second <= 0)
+                    {
+                        cout << "Делитель должен быть положительным!" << endl;
+                        continue;
+                    }
+                    if (condition.first < 0 || condition.first >= condition.second)
+                    {
+                        cout << "Остаток должен быть от 0 до делителя - 1!" << endl;
+                        continue;
+                    }
                 }
                 else
                 {
                     cout << "Неверный тип условия!" << endl;
+                    continue;
                 }
+                conditions.push_back(condition);
+                cout << "Добавлено условие: " << describeCondition(condition) << endl;
             }
             else if (action == 2) 
             {
@@ -417,24 +966,7 @@ public:
                 else {
                     for (size_t i = 0; i < conditions.size(); i++) 
                     {
-                        int type = conditions[i].first;
-                        int param = conditions[i].second;
-                        cout << i + 1 << ". ";
-                        if (type == 1) 
-                        {
-                            cout << (param == 0 ? "Четные числа" : "Нечетные числа");
-                        }
-                        else if (type == 2)
-                        {
-                            if (param == 0) cout << "Положительные числа";
-                            else if (param == 1) cout << "Отрицательные числа";
-                            else cout << "Ноль";
-                        }
-                        else if (type == 3) 
-                        {
-                            cout << "Числа, кратные " << param;
-                        }
-                        cout << endl;
+                        cout << i + 1 << ". " << describeCondition(conditions[i]) << endl;
                     }
                 }
             }
@@ -452,21 +984,22 @@ public:
         // Создание множества на основе выбранных условий
         if (conditions.empty()) {
             cout << "Условия не заданы. Используется множество по умолчанию (все четные числа)." << endl;
-            conditions.push_back({ 1, 0 }); // Четные по умолчанию
+            conditions.push_back({ ConditionType::Parity, 0, 0 }); // Четные по умолчанию
         }
 
-        sets[setIndex] = createSetFromConditions(conditions);
+        sets.modify(setIndex) = createSetFromConditions(conditions);
 
         // Если множество слишком большое, берем первые 10 элементов
-        if (sets[setIndex].size() > 10)
+        if (sets.at(setIndex).size() > 10)
         {
-            set<int> limitedSet;
-            auto it = sets[setIndex].begin();
-            for (int i = 0; i < 10 && it != sets[setIndex].end(); i++, it++)
+            UniverseSet limitedSet;
+            int taken = 0;
+            sets.at(setIndex).forEachWhile([&](int elem)
             {
-                limitedSet.insert(*it);
-            }
-            sets[setIndex] = limitedSet;
+                limitedSet.add(elem);
+                return ++taken < 10;
+            });
+            sets.modify(setIndex) = limitedSet;
             cout << "Множество ограничено 10 элементами." << endl;
         }
 
@@ -478,9 +1011,9 @@ public:
         cout << "\n=== ОСНОВНЫЕ ОПЕРАЦИИ НАД МНОЖЕСТВАМИ ===" << endl;
 
         // Вывод всех множеств
-        for (int i = 0; i < 3; i++)
+        for (int id : sets.ids())
         {
-            printSet(sets[i], string(1, 'A' + i));
+            printSet(sets.at(id), sets.nameOf(id));
         }
 
         while (true)
@@ -491,6 +1024,17 @@ public:
             cout << "3. Дополнение" << endl;
             cout << "4. Разность" << endl;
             cout << "5. Симметричная разность" << endl;
+            cout << "6. Создать множество" << endl;
+            cout << "7. Удалить множество" << endl;
+            cout << "8. Список множеств" << endl;
+            cout << "9. Мощности и отношения двух множеств" << endl;
+            cout << "10. Сохранить множества в файл" << endl;
+            cout << "11. Загрузить множества из файла" << endl;
+            cout << "12. Подмножества и декартово произведение" << endl;
+            cout << "13. Экспорт множества в файл" << endl;
+            cout << "14. Формат вывода множеств (список или отрезки)" << endl;
+            cout << "15. История: снимок, восстановление, отмена, различия" << endl;
+            cout << "16. Мультимножества" << endl;
             cout << "0. Перейти к формулам" << endl;
 
             int choice;
@@ -498,58 +1042,297 @@ public:
 
             if (choice == 0) break;
 
-            char set1, set2;
-            set<int> result;
+            UniverseSet result;
 
             switch (choice)
             {
             case 1: 
             { // Объединение
                 cout << "Введите два множества (например, A B): ";
-                cin >> set1 >> set2;
-                int idx1 = set1 - 'A';
-                int idx2 = set2 - 'A';
-                result = setUnion(sets[idx1], sets[idx2]);
-                printSet(result, string(1, set1) + " ∪ " + string(1, set2));
+                int id1 = readSet(), id2 = readSet();
+                if (id1 < 0 || id2 < 0) break;
+                result = setUnion(sets.at(id1), sets.at(id2));
+                printSet(result, sets.nameOf(id1) + " ∪ " + sets.nameOf(id2));
                 break;
             }
             case 2:
             { // Пересечение
                 cout << "Введите два множества (например, A B): ";
-                cin >> set1 >> set2;
-                int idx1 = set1 - 'A';
-                int idx2 = set2 - 'A';
-                result = setIntersection(sets[idx1], sets[idx2]);
-                printSet(result, string(1, set1) + " ∩ " + string(1, set2));
+                int id1 = readSet(), id2 = readSet();
+                if (id1 < 0 || id2 < 0) break;
+                result = setIntersection(sets.at(id1), sets.at(id2));
+                printSet(result, sets.nameOf(id1) + " ∩ " + sets.nameOf(id2));
                 break;
             }
             case 3:
             { // Дополнение
                 cout << "Введите множество (например, A): ";
-                cin >> set1;
-                int idx = set1 - 'A';
-                result = setComplement(sets[idx]);
-                printSet(result, "U \\ " + string(1, set1));
+                int id = readSet();
+                if (id < 0) break;
+                printSet(setComplement(sets.at(id)), "U \\ " + sets.nameOf(id));
                 break;
             }
             case 4:
             { // Разность
                 cout << "Введите два множества (например, A B): ";
-                cin >> set1 >> set2;
-                int idx1 = set1 - 'A';
-                int idx2 = set2 - 'A';
-                result = setDifference(sets[idx1], sets[idx2]);
-                printSet(result, string(1, set1) + " \\ " + string(1, set2));
+                int id1 = readSet(), id2 = readSet();
+                if (id1 < 0 || id2 < 0) break;
+                result = setDifference(sets.at(id1), sets.at(id2));
+                printSet(result, sets.nameOf(id1) + " \\ " + sets.nameOf(id2));
                 break;
             }
             case 5:
             { // Симметричная разность
                 cout << "Введите два множества (например, A B): ";
-                cin >> set1 >> set2;
-                int idx1 = set1 - 'A';
-                int idx2 = set2 - 'A';
-                result = setSymmetricDifference(sets[idx1], sets[idx2]);
-                printSet(result, string(1, set1) + " Δ " + string(1, set2));
+                int id1 = readSet(), id2 = readSet();
+                if (id1 < 0 || id2 < 0) break;
+                result = setSymmetricDifference(sets.at(id1), sets.at(id2));
+                printSet(result, sets.nameOf(id1) + " Δ " + sets.nameOf(id2));
+                break;
+            }
+            case 6:
+            { // Новое множество
+                cout << "Введите имя нового множества (латинские буквы, цифры, _): ";
+                string name;
+                cin >> name;
+                if (!SetRegistry::validName(name))
+                {
+                    cout << "Недопустимое имя множества." << endl;
+                    break;
+                }
+                if (sets.find(name) >= 0)
+                {
+                    cout << "Множество '" << name << "' уже существует." << endl;
+                    break;
+                }
+                fillSet(sets.create(name));
+                break;
+            }
+            case 7:
+            { // Удаление множества
+                cout << "Введите имя удаляемого множества: ";
+                string name;
+                cin >> name;
+                bool dropped = sets.drop(name);
+                if (dropped) history.forget(name);
+                cout << (dropped ? "Множество удалено." : "Множество не найдено.") << endl;
+                break;
+            }
+            case 8:
+            { // Список множеств
+                cout << "Множеств: " << sets.size() << endl;
+                for (int id : sets.ids())
+                {
+                    cout << sets.nameOf(id) << ": " << sets.at(id).size() << " элементов" << endl;
+                }
+                cout << "Кэш формул: " << cache.size() << " записей, попаданий " << cache.hits() << ", промахов " << cache.misses() << endl;
+                break;
+            }
+            case 9:
+            { // Мощности без построения результатов и проверки отношений
+                cout << "Введите два множества (например, A B): ";
+                int id1 = readSet(), id2 = readSet();
+                if (id1 < 0 || id2 < 0) break;
+                const UniverseSet& set1 = sets.at(id1);
+                const UniverseSet& set2 = sets.at(id2);
+                const string& name1 = sets.nameOf(id1);
+                const string& name2 = sets.nameOf(id2);
+                cout << "|" << name1 << " ∩ " << name2 << "| = " << setIntersectionSize(set1, set2) << endl;
+                cout << "|" << name1 << " ∪ " << name2 << "| = " << UniverseSet::combinedSize(set1, set2, SetOperation::Union) << endl;
+                cout << "|" << name1 << " \\ " << name2 << "| = " << UniverseSet::combinedSize(set1, set2, SetOperation::Difference) << endl;
+                cout << "|" << name1 << " Δ " << name2 << "| = " << UniverseSet::combinedSize(set1, set2, SetOperation::SymmetricDifference) << endl;
+                cout << name1 << " ⊆ " << name2 << ": " << (isSubset(set1, set2) ? "да" : "нет") << endl;
+                cout << name2 << " ⊆ " << name1 << ": " << (isSubset(set2, set1) ? "да" : "нет") << endl;
+                cout << "Не пересекаются: " << (areDisjoint(set1, set2) ? "да" : "нет") << endl;
+                break;
+            }
+            case 10:
+            case 11:
+            { // Двоичный снимок
+                cout << "Введите имя файла: ";
+                string path;
+                cin >> path;
+                try
+                {
+                    if (choice == 10)
+                    {
+                        saveSnapshot(path);
+                        cout << "Сохранено множеств: " << sets.size() << endl;
+                    }
+                    else
+                    {
+                        size_t loaded = loadSnapshot(path);
+                        cout << "Загружено множеств: " << loaded << ", универсум [" << universeMin << ", " << universeMax << "]" << endl;
+                    }
+                }
+                catch (const SnapshotError& error)
+                {
+                    cout << "Ошибка: " << error.what() << endl;
+                }
+                break;
+            }
+            case 12:
+            { // Ленивый перебор: элементы выводятся по мере построения
+                cout << "1 - все подмножества, 2 - подмножества из k элементов, 3 - декартово произведение двух множеств: ";
+                int kind;
+                cin >> kind;
+                if (kind < 1 || kind > 3)
+                {
+                    cout << "Неверный выбор!" << endl;
+                    break;
+                }
+                cout << (kind == 3 ? "Введите два множества (например, A B): " : "Введите множество (например, A): ");
+                int id1 = readSet(), id2 = kind == 3 ? readSet() : id1;
+                if (id1 < 0 || id2 < 0) break;
+                long long k = -1;
+                if (kind == 2)
+                {
+                    cout << "Введите k: ";
+                    cin >> k;
+                    if (k < 0)
+                    {
+                        cout << "Ожидалось k >= 0." << endl;
+                        break;
+                    }
+                }
+                cout << flush;
+                BufferedWriter out(stdout);
+                try
+                {
+                    if (kind == 3) writeProduct(out, { id1, id2 });
+                    else writeSubsets(out, id1, k);
+                }
+                catch (const FormulaError& error)
+                {
+                    out.write("Ошибка: ");
+                    out.write(error.what());
+                    out.write('\n');
+                }
+                break;
+            }
+            case 13:
+            { // Экспорт множества
+                cout << "Введите множество, формат (list, intervals, binary) и имя файла: ";
+                int id = readSet();
+                string format, path;
+                cin >> format >> path;
+                if (id < 0) break;
+                try
+                {
+                    exportSet(id, path, format);
+                    cout << "Записано элементов: " << sets.at(id).size() << endl;
+                }
+                catch (const FormulaError& error)
+                {
+                    cout << "Ошибка: " << error.what() << endl;
+                }
+                break;
+            }
+            case 14:
+            { // Формат вывода
+                cout << "Введите формат (list - {1, 2, 3}, intervals - {1..3}): ";
+                string format;
+                cin >> format;
+                if (!parseSetFormat(format, outputFormat)) cout << "Неизвестный формат." << endl;
+                break;
+            }
+            case 15:
+            { // Версии множеств
+                cout << "1 - снимок всех множеств, 2 - восстановить снимок, 3 - отменить изменение множества, "
+                    << "4 - различия с предыдущей версией, 5 - различия со снимком: ";
+                int kind;
+                cin >> kind;
+                try
+                {
+                    if (kind == 1 || kind == 2)
+                    {
+                        cout << "Введите метку снимка: ";
+                        string tag;
+                        cin >> tag;
+                        if (kind == 1) takeSnapshot(tag);
+                        else cout << "Восстановлено множеств: " << restoreSnapshot(tag) << endl;
+                    }
+                    else if (kind >= 3 && kind <= 5)
+                    {
+                        cout << "Введите множество (например, A): ";
+                        int id = readSet();
+                        if (id < 0) break;
+                        string tag;
+                        if (kind == 5)
+                        {
+                            cout << "Введите метку снимка: ";
+                            cin >> tag;
+                        }
+                        if (kind == 3)
+                        {
+                            if (undoChange(id)) printSet(sets.at(id), sets.nameOf(id));
+                            else cout << "Отменять нечего." << endl;
+                        }
+                        else
+                        {
+                            cout << flush;
+                            BufferedWriter out(stdout);
+                            writeDiff(out, id, tag);
+                        }
+                    }
+                    else
+                    {
+                        cout << "Неверный выбор!" << endl;
+                    }
+                }
+                catch (const FormulaError& error)
+                {
+                    cout << "Ошибка: " << error.what() << endl;
+                }
+                break;
+            }
+            case 16:
+            { // Мультимножества
+                cout << "1 - мультимножество из множества, 2 - операция над мультимножествами, "
+                    << "3 - множество элементов мультимножества: ";
+                int kind;
+                cin >> kind;
+                try
+                {
+                    if (kind == 1)
+                    {
+                        cout << "Введите имя мультимножества и множество (например, M A): ";
+                        string name;
+                        cin >> name;
+                        int id = readSet();
+                        if (id < 0) break;
+                        const Multiset& bag = bagFromSet(name, id);
+                        cout << flush;
+                        BufferedWriter out(stdout);
+                        writeBag(out, bag, name);
+                    }
+                    else if (kind == 2)
+                    {
+                        cout << "Введите результат, операнды и операцию (+ сумма, | max, & min, - разность), например R M + N: ";
+                        string target, left, op, right;
+                        cin >> target >> left >> op >> right;
+                        const Multiset& bag = bagOperation(target, left, op, right);
+                        cout << flush;
+                        BufferedWriter out(stdout);
+                        writeBag(out, bag, target);
+                    }
+                    else if (kind == 3)
+                    {
+                        cout << "Введите имя множества и мультимножество (например, S M): ";
+                        string name, bagName;
+                        cin >> name >> bagName;
+                        int id = setFromBag(name, bagName);
+                        printSet(sets.at(id), name);
+                    }
+                    else
+                    {
+                        cout << "Неверный выбор!" << endl;
+                    }
+                }
+                catch (const FormulaError& error)
+                {
+                    cout << "Ошибка: " << error.what() << endl;
+                }
                 break;
             }
             default:
@@ -567,7 +1350,12 @@ public:
         cout << "-  - разность (A-B)" << endl;
         cout << "^  - симметричная разность (A^B)" << endl;
         cout << "!  - дополнение (!A)" << endl;
-        cout << "Примеры формул: A+B, A*B, A-B, A^B, !A" << endl;
+        cout << "U  - универсум, {} - пустое множество" << endl;
+        cout << "Приоритет: ! выше *, * выше +, - и ^; допускаются скобки" << endl;
+        cout << "Примеры формул: A+B, A*B, A-B, A^B, !A, !(A+B)*(C^A)-B" << endl;
+        cout << "Сохранение результата: ИМЯ = формула (например, D = A*B)" << endl;
+        cout << "Запросы: |A*B| - мощность, A <= B - подмножество, A >= B - надмножество," << endl;
+        cout << "         A == B - равенство, A # B - не пересекаются" << endl;
         cout << "Для выхода введите 'exit'" << endl;
 
         cin.ignore(); // Очищаем буфер
@@ -580,24 +1368,268 @@ public:
 
             if (formula == "exit") break;
 
-            // Удаляем пробелы из формулы
-            formula.erase(remove(formula.begin(), formula.end(), ' '), formula.end());
+            // Присваивание "ИМЯ = формула" сохраняет результат в реестре под этим именем
+            string target;
+            size_t offset = 0;
+            size_t assign = findAssignment(formula);
+            if (assign != string::npos)
+            {
+                target = formula.substr(0, assign);
+                target.erase(remove(target.begin(), target.end(), ' '), target.end());
+                if (!SetRegistry::validName(target))
+                {
+                    cout << "Ошибка: недопустимое имя множества '" << target << "'" << endl;
+                    continue;
+                }
+                offset = assign + 1;
+            }
 
-            set<int> result = evaluateFormula(formula);
-            if (!result.empty())
+            try
             {
-                printSet(result, formula);
+                FormulaQuery query = parseQuery(formula.substr(offset));
+                if (query.type != QueryType::Value)
+                {
+                    // Мощность или отношение: результат - число или да/нет
+                    if (!target.empty()) throw FormulaError("результат запроса нельзя сохранить как множество", 0);
+                    simplifyQuery(query);
+                    StringWriter answer;
+                    writeQueryAnswer(answer, query, formula);
+                    cout << answer.str();
+                    continue;
+                }
+
+                const Formula& parsed = query.left;
+                Formula compiled = simplifyFormula(parsed);
+                if (compiled.instructions().size() < parsed.instructions().size())
+                {
+                    cout << "Упрощённая формула: " << compiled.text() << endl;
+                }
+                SetHandle result = evaluateFormula(compiled);
+                if (target.empty())
+                {
+                    printSet(result, formula);
+                }
+                else
+                {
+                    int id = sets.create(target);
+                    storeSet(id, result.materialize());
+                    printSet(sets.at(id), target);
+                }
             }
-            else
+            catch (const FormulaError& error)
+            {
+                // Указываем место ошибки под текстом формулы
+                cout << "Ошибка: " << error.what() << " (позиция " << offset + error.position() + 1 << ")" << endl;
+                cout << "  " << formula << endl;
+                cout << "  " << string(offset + error.position(), ' ') << "^" << endl;
+            }
+        }
+    }
+
+    // Пакетный режим: сценарий читается построчно без меню и приглашений, результаты
+    // пишутся через буферизованный вывод в порядке строк сценария. Строки сценария:
+    //   universe MIN MAX         - границы универсума
+    //   set ИМЯ 1 2 10..20       - множество из чисел и отрезков
+    //   drop ИМЯ                 - удаление множества
+    //   seed N                   - зерно генератора для воспроизводимых случайных множеств
+    //   random ИМЯ K             - случайное множество из K различных чисел универсума
+    //   random ИМЯ K N           - N случайных множеств ИМЯ1..ИМЯN (строятся параллельно, выводится только итог)
+    //   save ФАЙЛ                - запись всех множеств в двоичный снимок
+    //   load ФАЙЛ                - загрузка снимка (файл отображается в память, множества не выводятся)
+    //   subsets ИМЯ [K]          - все подмножества или подмножества из K элементов (до 63 элементов)
+    //   product ИМЯ1 ИМЯ2 ...    - декартово произведение, по кортежу в строке
+    //   format list|intervals    - запись множеств в выводе: списком {1, 2, 3} или отрезками {1..3}
+    //   export ИМЯ ФОРМАТ ФАЙЛ   - запись множества в файл (list, intervals или binary)
+    //   snapshot МЕТКА           - снимок всех множеств (версии разделяют данные, копирования нет)
+    //   restore МЕТКА            - восстановление множеств снимка
+    //   undo ИМЯ                 - отмена последнего изменения множества
+    //   diff ИМЯ [МЕТКА]         - различия с предыдущей версией или с версией из снимка
+    //   bag ИМЯ 1 2:3 10..20:2   - мультимножество из чисел и отрезков с кратностями (:1 по умолчанию)
+    //   bag ИМЯ = X ОП Y         - операция над мультимножествами: + сумма, | max, & min, - усечённая разность
+    //   tobag ИМЯ МНОЖЕСТВО      - мультимножество из множества (кратности 1)
+    //   toset ИМЯ МУЛЬТИМНОЖЕСТВО - множество элементов мультимножества
+    //   ИМЯ = формула            - вычисление с сохранением результата
+    //   формула                  - вычисление и вывод результата
+    //   |формула|, F <= G, F >= G, F == G, F # G - мощность и отношения (см. compileQuery)
+    // Пустые строки и строки, начинающиеся с '#', пропускаются. Ошибка в строке не прерывает обработку.
+    // Возвращает число строк с ошибками.
+    int runBatch(istream& input, BufferedWriter& out)
+    {
+        int errors = 0;
+        long long lineNumber = 0;
+        string line;
+        vector<BatchLine> pending;
+        while (getline(input, line))
+        {
+            lineNumber++;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            size_t start = line.find_first_not_of(" \t");
+            if (start == string::npos || line[start] == '#') continue;
+
+            // Формулы без присваивания откладываются для параллельного вычисления блоком
+            size_t wordEnd = line.find_first_of(" \t", start);
+            string command = line.substr(start, wordEnd == string::npos ? string::npos : wordEnd - start);
+            size_t assign = findAssignment(line);
+            if (assign == string::npos && !SetRegistry::isBatchCommand(command))
+            {
+                pending.push_back({ lineNumber, line.substr(start), false });
+                if (pending.size() >= BatchBlockLines) errors += flushBatch(pending, out);
+                continue;
+            }
+            // Остальные строки меняют состояние, поэтому сначала вычисляются накопленные формулы
+            errors += flushBatch(pending, out);
+
+            try
+            {
+                istringstream words(line.substr(start));
+                words >> command;
+                if (command == "universe")
+                {
+                    long long minValue, maxValue;
+                    if (!(words >> minValue >> maxValue) || minValue > maxValue || minValue < INT_MIN || maxValue > INT_MAX)
+                    {
+                        throw FormulaError("ожидались 32-битные границы min <= max", 0);
+                    }
+                    initializeUniverse(static_cast<int>(minValue), static_cast<int>(maxValue));
+                    continue;
+                }
+                if (command == "set")
+                {
+                    batchDefineSet(words, out);
+                    continue;
+                }
+                if (command == "seed")
+                {
+                    unsigned long long seed;
+                    if (!(words >> seed)) throw FormulaError("ожидалось зерно - неотрицательное целое", 0);
+                    sampler.reseed(seed);
+                    continue;
+                }
+                if (command == "random")
+                {
+                    batchRandomSets(words, out);
+                    continue;
+                }
+                if (command == "save" || command == "load")
+                {
+                    string path;
+                    getline(words >> ws, path);
+                    while (!path.empty() && (path.back() == ' ' || path.back() == '\t')) path.pop_back();
+                    if (path.empty()) throw FormulaError("ожидалось имя файла", 0);
+                    try
+                    {
+                        if (command == "save") saveSnapshot(path);
+                        else loadSnapshot(path);
+                    }
+                    catch (const SnapshotError& error)
+                    {
+                        throw FormulaError(error.what(), 0);
+                    }
+                    continue;
+                }
+                if (command == "subsets" || command == "product")
+                {
+                    batchEnumeration(command, words, out);
+                    continue;
+                }
+                if (command == "format")
+                {
+                    string name;
+                    words >> name;
+                    if (!parseSetFormat(name, outputFormat)) throw FormulaError("неизвестный формат '" + name + "' (list, intervals)", 0);
+                    continue;
+                }
+                if (command == "export")
+                {
+                    string name, format, path;
+                    words >> name >> format;
+                    getline(words >> ws, path);
+                    while (!path.empty() && (path.back() == ' ' || path.back() == '\t')) path.pop_back();
+                    int id = sets.find(name);
+                    if (id < 0) throw FormulaError("множество '" + name + "' не найдено", 0);
+                    if (path.empty()) throw FormulaError("ожидалось имя файла", 0);
+                    exportSet(id, path, format);
+                    continue;
+                }
+                if (command == "snapshot" || command == "restore")
+                {
+                    string tag;
+                    if (!(words >> tag)) throw FormulaError("ожидалась метка снимка", 0);
+                    if (command == "snapshot") takeSnapshot(tag);
+                    else restoreSnapshot(tag);
+                    continue;
+                }
+                if (command == "undo" || command == "diff")
+                {
+                    string name, tag;
+                    words >> name >> tag;
+                    int id = sets.find(name);
+                    if (id < 0) throw FormulaError("множество '" + name + "' не найдено", 0);
+                    if (command == "diff")
+                    {
+                        writeDiff(out, id, tag);
+                        continue;
+                    }
+                    if (!undoChange(id)) throw FormulaError("у множества '" + name + "' нет предыдущей версии", 0);
+                    writeSet(out, sets.at(id), name);
+                    continue;
+                }
+                if (command == "bag")
+                {
+                    batchDefineBag(words, out);
+                    continue;
+                }
+                if (command == "tobag" || command == "toset")
+                {
+                    string name, source;
+                    words >> name >> source;
+                    if (command == "toset")
+                    {
+                        int id = setFromBag(name, source);
+                        writeSet(out, sets.at(id), name);
+                        continue;
+                    }
+                    int id = sets.find(source);
+                    if (id < 0) throw FormulaError("множество '" + source + "' не найдено", 0);
+                    writeBag(out, bagFromSet(name, id), name);
+                    continue;
+                }
+                if (command == "drop")
+                {
+                    string name;
+                    words >> name;
+                    if (!sets.drop(name)) throw FormulaError("множество '" + name + "' не найдено", 0);
+                    history.forget(name);
+                    continue;
+                }
+
+                // Присваивание "ИМЯ = формула"
+                string target = line.substr(0, assign);
+                target.erase(remove_if(target.begin(), target.end(), [](char c) { return c == ' ' || c == '\t'; }), target.end());
+                if (!SetRegistry::validName(target)) throw FormulaError("недопустимое имя множества '" + target + "'", 0);
+
+                FormulaQuery query = compileFormulaQuery(line.substr(assign + 1));
+                if (query.type != QueryType::Value) throw FormulaError("результат запроса нельзя сохранить как множество", 0);
+                SetHandle result = evaluateFormula(query.left);
+                int id = sets.create(target);
+                storeSet(id, result.materialize());
+                writeSet(out, sets.at(id), target);
+            }
+            catch (const FormulaError& error)
             {
-                cout << "Ошибка: неверный формат формулы или несуществующие множества!" << endl;
+                errors++;
+                writeBatchError(out, lineNumber, error);
             }
         }
+        errors += flushBatch(pending, out);
+        out.flush();
+        return errors;
     }
 
     void run()
     {
         cout << "=== КАЛЬКУЛЯТОР МНОЖЕСТВ ===" << endl;
+        configureUniverse();
         createSets();
         performOperations();
         evaluateFormulas();
@@ -605,10 +1637,28 @@ public:
     }
 };
 
-int main()
+// Запуск: без аргументов - интерактивный режим;
+// --batch [файл] - пакетная обработка сценария из файла или стандартного ввода
+int main(int argc, char* argv[])
 {
     setlocale(LC_ALL, "RU");
     SetCalculator calculator;
+    if (argc > 1 && string(argv[1]) == "--batch")
+    {
+        ios::sync_with_stdio(false);
+        BufferedWriter out(stdout);
+        if (argc > 2)
+        {
+            ifstream script(argv[2]);
+            if (!script)
+            {
+                cerr << "Не удалось открыть файл " << argv[2] << endl;
+                return 1;
+            }
+            return calculator.runBatch(script, out) == 0 ? 0 : 2;
+        }
+        return calculator.runBatch(cin, out) == 0 ? 0 : 2;
+    }
     calculator.run();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,113 @@
+﻿#include <iostream>
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdio>
+#include <clocale>
+#include "RoaringSet.h"
+#include "SetSampler.h"
+#include "SetSnapshot.h"
+
+using namespace std;
+
+// Регрессионные тесты двоичных снимков (SetSnapshot.h):
+//   - сохранение поверх снимка, который сейчас загружен (его контейнеры ссылаются на отображение файла);
+//   - отказ в загрузке снимка с именем множества, недопустимым для калькулятора.
+// Запуск: "Тесты снимков.exe [путь к временному файлу]"; код возврата 0, если все проверки пройдены.
+
+static int failures = 0;
+
+static void expect(bool condition, const string& what)
+{
+    if (!condition)
+    {
+        cout << "ОШИБКА: " << what << endl;
+        failures++;
+    }
+}
+
+typedef vector<pair<string, const RoaringSet*>> NamedSets;
+
+static NamedSets named(const vector<pair<string, RoaringSet>>& sets)
+{
+    NamedSets result;
+    for (const auto& set : sets) result.push_back({ set.first, &set.second });
+    return result;
+}
+
+static bool sameSets(const vector<pair<string, RoaringSet>>& a, const vector<pair<string, RoaringSet>>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].first != b[i].first || !RoaringSet::equals(a[i].second, b[i].second)) return false;
+    }
+    return true;
+}
+
+// Загрузка снимка и повторное сохранение загруженных множеств в тот же файл:
+// раньше файл обрезался под живым отображением, и чтение контейнеров падало с SIGBUS
+static void testSaveOverLoaded(const string& path)
+{
+    const int first = 0, last = 10000000;
+    SetSampler sampler(1);
+    vector<pair<string, RoaringSet>> original;
+    original.push_back({ "Dense", sampler.sample(3000000, first, last) });
+    original.push_back({ "Sparse", sampler.sample(1000, first, last) });
+    RoaringSet ranges;
+    ranges.addRange(100, 200000);
+    ranges.addRange(5000000, 5100000);
+    original.push_back({ "Ranges", ranges });
+    SetSnapshot::save(path, named(original), first, last);
+
+    SetSnapshot::Contents loaded = SetSnapshot::load(path);
+    expect(sameSets(loaded.sets, original), "загруженный снимок отличается от сохранённого");
+
+    SetSnapshot::save(path, named(loaded.sets), loaded.universeMin, loaded.universeMax);
+    expect(sameSets(loaded.sets, original), "загруженные множества изменились после сохранения в тот же файл");
+
+    SetSnapshot::Contents reloaded = SetSnapshot::load(path);
+    expect(reloaded.universeMin == first && reloaded.universeMax == last, "границы универсума не сохранились");
+    expect(sameSets(reloaded.sets, original), "повторно сохранённый снимок отличается от исходного");
+}
+
+// Имя, по которому множество нельзя назвать в формуле, - признак повреждённого файла
+static void testInvalidName(const string& path)
+{
+    RoaringSet set;
+    set.add(1);
+    vector<pair<string, RoaringSet>> sets;
+    sets.push_back({ "1A", set });
+    SetSnapshot::save(path, named(sets), 0, 10);
+
+    bool rejected = false;
+    try
+    {
+        SetSnapshot::load(path);
+    }
+    catch (const SnapshotError&)
+    {
+        rejected = true;
+    }
+    expect(rejected, "снимок с недопустимым именем множества загружен");
+}
+
+int main(int argc, char* argv[])
+{
+    setlocale(LC_ALL, "RU");
+    string path = argc > 1 ? argv[1] : "snapshot_test.snap";
+    try
+    {
+        testSaveOverLoaded(path);
+        testInvalidName(path);
+    }
+    catch (const SnapshotError& error)
+    {
+        cout << "ОШИБКА: " << error.what() << endl;
+        failures++;
+    }
+    remove(path.c_str());
+
+    if (failures == 0) cout << "Все проверки пройдены" << endl;
+    return failures == 0 ? 0 : 1;
+}
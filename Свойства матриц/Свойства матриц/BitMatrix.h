@@ -0,0 +1,152 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include "BitOps.h"
+
+// Квадратная булева матрица n x n, по одному биту на элемент.
+// Все строки лежат подряд в одном буфере, выровненном на 64 байта (строку кэша):
+// строка дополнена до целого числа строк кэша (по 8 слов), а число строк - до кратного 64,
+// чтобы блоки 64 x 64 читались без проверок границ. Биты за пределами n всегда нулевые.
+// Элемент (i, j) - бит j % 64 слова j / 64 строки i.
+class BitMatrix
+{
+public:
+    static const size_t WordBits = 64;
+    static const size_t LineWords = 8;      // Слов в строке кэша
+    static const size_t Alignment = 64;
+
+private:
+    struct AlignedDelete
+    {
+        void operator()(uint64_t* words) const
+        {
+            ::operator delete[](words, std::align_val_t(Alignment));
+        }
+    };
+
+    size_t n;
+    size_t stride;          // Слов в строке (кратно LineWords)
+    size_t rowCount;        // Строк в буфере (кратно WordBits)
+    std::unique_ptr<uint64_t[], AlignedDelete> words;
+
+public:
+    explicit BitMatrix(size_t size = 0)
+        : n(size),
+        stride((size + WordBits * LineWords - 1) / (WordBits * LineWords) * LineWords),
+        rowCount((size + WordBits - 1) / WordBits * WordBits)
+    {
+        size_t total = stride * rowCount;
+        if (total == 0) return;
+        words.reset(static_cast<uint64_t*>(::operator new[](total * sizeof(uint64_t), std::align_val_t(Alignment))));
+        clear();
+    }
+
+    BitMatrix(BitMatrix&&) = default;
+    BitMatrix& operator=(BitMatrix&&) = default;
+
+    size_t size() const
+    {
+        return n;
+    }
+
+    // Слов в строке, включая дополнение
+    size_t rowWords() const
+    {
+        return stride;
+    }
+
+    // Слов, в которых есть элементы строки
+    size_t usedWords() const
+    {
+        return (n + WordBits - 1) / WordBits;
+    }
+
+    // Объём буфера в байтах
+    size_t memoryBytes() const
+    {
+        return stride * rowCount * sizeof(uint64_t);
+    }
+
+    // Маска существующих столбцов в слове word строки
+    uint64_t columnMask(size_t word) const
+    {
+        size_t rest = n - word * WordBits;
+        return rest >= WordBits ? ~0ull : (1ull << rest) - 1;
+    }
+
+    uint64_t* row(size_t i)
+    {
+        return words.get() + i * stride;
+    }
+
+    const uint64_t* row(size_t i) const
+    {
+        return words.get() + i * stride;
+    }
+
+    bool get(size_t i, size_t j) const
+    {
+        return (row(i)[j / WordBits] >> (j % WordBits)) & 1;
+    }
+
+    void set(size_t i, size_t j, bool value)
+    {
+        uint64_t bit = 1ull << (j % WordBits);
+        uint64_t& word = row(i)[j / WordBits];
+        word = value ? word | bit : word & ~bit;
+    }
+
+    // Число единиц в матрице
+    uint64_t count() const
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            const uint64_t* words = row(i);
+            for (size_t w = 0; w < usedWords(); w++) total += bitCount(words[w]);
+        }
+        return total;
+    }
+
+    // Строка a - подмножество строки b: a & ~b == 0 во всех словах
+    bool rowSubset(size_t a, size_t b) const
+    {
+        const uint64_t* left = row(a);
+        const uint64_t* right = row(b);
+        uint64_t extra = 0;
+        for (size_t w = 0; w < usedWords(); w++) extra |= left[w] & ~right[w];
+        return extra == 0;
+    }
+
+    void clear()
+    {
+        if (words) std::memset(words.get(), 0, stride * rowCount * sizeof(uint64_t));
+    }
+
+    // Блок 64 x 64: строки 64 * blockRow .. 64 * blockRow + 63, слово blockColumn каждой из них
+    void loadBlock(size_t blockRow, size_t blockColumn, uint64_t block[WordBits]) const
+    {
+        const uint64_t* source = row(blockRow * WordBits) + blockColumn;
+        for (size_t r = 0; r < WordBits; r++) block[r] = source[r * stride];
+    }
+
+    // Транспонирование блока 64 x 64 на месте: бит c слова r меняется с битом r слова c.
+    // Рекурсивный обмен четвертей: 32 x 32, затем 16 x 16 и так до 1 x 1, по 6 проходов из 32 обменов
+    static void transpose(uint64_t block[WordBits])
+    {
+        uint64_t mask = 0x00000000FFFFFFFFull;
+        for (size_t width = 32; width != 0; width >>= 1, mask ^= mask << width)
+        {
+            for (size_t k = 0; k < WordBits; k = ((k | width) + 1) & ~width)
+            {
+                uint64_t swapped = ((block[k] >> width) ^ block[k | width]) & mask;
+                block[k] ^= swapped << width;
+                block[k | width] ^= swapped;
+            }
+        }
+    }
+};
@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Переносимые битовые примитивы над 64-битными словами.
+// В MSVC используются встроенные функции, в GCC/Clang - __builtin_*.
+
+// Количество установленных битов в слове
+inline int bitCount(uint64_t word)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<int>(__popcnt64(word));
+#elif defined(_MSC_VER)
+    return static_cast<int>(__popcnt(static_cast<uint32_t>(word)) + __popcnt(static_cast<uint32_t>(word >> 32)));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// Номер младшего установленного бита (слово не должно быть нулевым)
+inline int lowestBit(uint64_t word)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<uint32_t>(word))) return static_cast<int>(index);
+    _BitScanForward(&index, static_cast<uint32_t>(word >> 32));
+    return static_cast<int>(index) + 32;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
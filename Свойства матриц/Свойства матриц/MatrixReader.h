@@ -0,0 +1,248 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <istream>
+#include <new>
+#include <string>
+#include <vector>
+#include "BitMatrix.h"
+#include "SparseRelation.h"
+
+// Чтение отношения из текстового файла в одном из двух видов:
+// - матрица (read): n строк по n значений 0 или 1 через пробелы, размер n определяется
+//   по числу значений в первой строке; значения сразу записываются в битовую матрицу;
+// - список пар (readPairs): число элементов n, затем пары номеров "a b" (от 1 до n) для aRb;
+//   пары раскладываются по спискам соседей (SparseRelation.h).
+// Файл читается блоками по 1 МБ, поэтому память сверх самого отношения не зависит от размера файла.
+class MatrixReader
+{
+public:
+    static const int EndOfData = -1;
+    static const int BadValue = -2;
+
+private:
+    static const size_t BufferSize = 1 << 20;
+
+    std::istream& input;
+    std::vector<char> buffer;
+    size_t position;
+    size_t length;
+    bool lineBreak;         // Перед последним прочитанным значением был перевод строки
+    bool pendingBreak;      // Значение завершилось переводом строки
+
+    int nextChar()
+    {
+        if (position == length)
+        {
+            input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            length = static_cast<size_t>(input.gcount());
+            position = 0;
+            if (length == 0) return EOF;
+        }
+        return static_cast<unsigned char>(buffer[position++]);
+    }
+
+    static bool isSpace(int c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    // Следующее значение: 0 или 1, EndOfData в конце файла, BadValue для любого другого слова
+    int nextValue()
+    {
+        lineBreak = pendingBreak;
+        pendingBreak = false;
+        int c = nextChar();
+        while (isSpace(c))
+        {
+            if (c == '\n') lineBreak = true;
+            c = nextChar();
+        }
+        if (c == EOF) return EndOfData;
+        if (c != '0' && c != '1') return BadValue;
+        int after = nextChar();
+        if (after != EOF && !isSpace(after)) return BadValue;
+        pendingBreak = after == '\n';
+        return c - '0';
+    }
+
+    // Следующее неотрицательное целое в number: 0, EndOfData в конце файла или BadValue
+    int nextNumber(uint64_t& number)
+    {
+        int c = nextChar();
+        while (isSpace(c)) c = nextChar();
+        if (c == EOF) return EndOfData;
+        number = 0;
+        bool digits = false;
+        for (; c >= '0' && c <= '9'; c = nextChar())
+        {
+            if (number > (UINT64_MAX - 9) / 10) return BadValue;
+            number = number * 10 + static_cast<uint64_t>(c - '0');
+            digits = true;
+        }
+        if (!digits || (c != EOF && !isSpace(c))) return BadValue;
+        return 0;
+    }
+
+    // Следующая пара номеров элементов от 1 до n, переведённых в индексы от 0
+    int nextPair(uint64_t n, uint64_t& a, uint64_t& b)
+    {
+        int status = nextNumber(a);
+        if (status != 0) return status;
+        if (nextNumber(b) != 0 || a == 0 || b == 0 || a > n || b > n) return BadValue;
+        a--;
+        b--;
+        return 0;
+    }
+
+    // Метка порядка байтов UTF-8 в начале файла пропускается
+    void skipByteOrderMark()
+    {
+        if (nextChar() == 0xEF && nextChar() == 0xBB && nextChar() == 0xBF) return;
+        position = 0;
+    }
+
+    // Возврат к началу файла для второго прохода
+    void rewind()
+    {
+        input.clear();
+        input.seekg(0);
+        position = 0;
+        length = 0;
+        skipByteOrderMark();
+    }
+
+public:
+    explicit MatrixReader(std::istream& stream)
+        : input(stream), buffer(BufferSize), position(0), length(0), lineBreak(false), pendingBreak(false)
+    {
+        skipByteOrderMark();
+    }
+
+    // Чтение всей матрицы в result; при ошибке result не меняется, а описание записывается в error
+    bool read(BitMatrix& result, std::string& error)
+    {
+        int value = nextValue();
+        if (value == EndOfData)
+        {
+            error = "файл не содержит данных";
+            return false;
+        }
+
+        std::vector<char> firstRow;
+        while (value >= 0)
+        {
+            firstRow.push_back(static_cast<char>(value));
+            value = nextValue();
+            if (lineBreak) break;
+        }
+
+        if (value == BadValue)
+        {
+            error = "файл содержит значения, отличные от 0 и 1";
+            return false;
+        }
+
+        size_t n = firstRow.size();
+        BitMatrix loaded;
+        try
+        {
+            loaded = BitMatrix(n);
+        }
+        catch (const std::bad_alloc&)
+        {
+            error = "недостаточно памяти для матрицы " + std::to_string(n) + "x" + std::to_string(n);
+            return false;
+        }
+        for (size_t j = 0; j < n; j++) loaded.set(0, j, firstRow[j] == 1);
+
+        for (size_t i = 1; i < n; i++)
+        {
+            uint64_t* row = loaded.row(i);
+            for (size_t j = 0; j < n; j++)
+            {
+                if (value < 0)
+                {
+                    error = value == BadValue ? "файл содержит значения, отличные от 0 и 1"
+                        : "недостаточно данных: ожидалось " + std::to_string(n) + " строк по " + std::to_string(n) + " значений";
+                    return false;
+                }
+                if (value == 1) row[j / BitMatrix::WordBits] |= 1ull << (j % BitMatrix::WordBits);
+                value = nextValue();
+            }
+        }
+
+        if (value == BadValue)
+        {
+            error = "файл содержит значения, отличные от 0 и 1";
+            return false;
+        }
+        if (value != EndOfData)
+        {
+            error = "после " + std::to_string(n) + " строк по " + std::to_string(n) + " значений в файле есть лишние данные";
+            return false;
+        }
+        result = std::move(loaded);
+        return true;
+    }
+
+    // Чтение отношения списком пар в result; при ошибке result не меняется.
+    // Файл читается дважды: первый проход проверяет пары и считает степени элементов,
+    // второй раскладывает пары по уже выделенным спискам
+    bool readPairs(SparseRelation& result, std::string& error)
+    {
+        uint64_t n;
+        int status = nextNumber(n);
+        if (status == EndOfData)
+        {
+            error = "файл не содержит данных";
+            return false;
+        }
+        if (status == BadValue || n == 0 || n > SparseRelation::MaxSize)
+        {
+            error = "в начале файла должно быть число элементов от 1 до " + std::to_string(SparseRelation::MaxSize);
+            return false;
+        }
+
+        SparseRelation loaded;
+        uint64_t a, b;
+        uint64_t pairs = 0;
+        try
+        {
+            loaded = SparseRelation(n);
+            while ((status = nextPair(n, a, b)) == 0)
+            {
+                loaded.countPair(a);
+                pairs++;
+            }
+            if (status == BadValue)
+            {
+                error = "пары должны состоять из двух номеров элементов от 1 до " + std::to_string(n);
+                return false;
+            }
+            loaded.startFill();
+        }
+        catch (const std::bad_alloc&)
+        {
+            error = "недостаточно памяти для отношения на " + std::to_string(n) + " элементах";
+            return false;
+        }
+
+        rewind();
+        nextNumber(n);
+        for (uint64_t k = 0; k < pairs; k++)
+        {
+            if (nextPair(n, a, b) != 0)
+            {
+                error = "файл изменился во время чтения";
+                return false;
+            }
+            loaded.addPair(a, b);
+        }
+        loaded.finishFill();
+        result = std::move(loaded);
+        return true;
+    }
+};
@@ -0,0 +1,184 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "BitMatrix.h"
+
+// Разреженное отношение в формате CSR: для каждого элемента i - отсортированный список j с iRj.
+// Списки всех строк лежат подряд в targets, строка i занимает targets[offsets[i] .. offsets[i + 1]).
+// Память - 8 байт на элемент и 4 байта на пару отношения, поэтому отношение на 10 млн элементов
+// со средней степенью 10 занимает около 0,5 ГБ, а битовая матрица того же размера - 12,5 ТБ
+class SparseRelation
+{
+public:
+    typedef uint32_t Element;
+    static const size_t MaxSize = UINT32_MAX;
+
+private:
+    std::vector<uint64_t> offsets;
+    std::vector<Element> targets;
+
+public:
+    // Пустое отношение на n элементах
+    explicit SparseRelation(size_t n = 0) : offsets(n + 1, 0)
+    {
+    }
+
+    size_t size() const
+    {
+        return offsets.size() - 1;
+    }
+
+    uint64_t pairCount() const
+    {
+        return targets.size();
+    }
+
+    // Объём списков в байтах для отношения из pairs пар на n элементах
+    static uint64_t memoryBytes(size_t n, uint64_t pairs)
+    {
+        return (static_cast<uint64_t>(n) + 1) * sizeof(uint64_t) + pairs * sizeof(Element);
+    }
+
+    uint64_t memoryBytes() const
+    {
+        return memoryBytes(size(), pairCount());
+    }
+
+    // Отсортированный список j с iRj: [begin(i), end(i))
+    const Element* begin(size_t i) const
+    {
+        return targets.data() + offsets[i];
+    }
+
+    const Element* end(size_t i) const
+    {
+        return targets.data() + offsets[i + 1];
+    }
+
+    bool contains(size_t i, size_t j) const
+    {
+        return std::binary_search(begin(i), end(i), static_cast<Element>(j));
+    }
+
+    // Строка a - подмножество строки b
+    bool rowSubset(size_t a, size_t b) const
+    {
+        return std::includes(begin(b), end(b), begin(a), end(a));
+    }
+
+    bool operator==(const SparseRelation& other) const
+    {
+        return offsets == other.offsets && targets == other.targets;
+    }
+
+    // Построение по парам в два прохода: countPair(i) для каждой пары (i, j), затем startFill()
+    // и addPair(i, j) для тех же пар в любом порядке, затем finishFill() - сортировка строк
+    // и удаление повторов. Памяти нужно только на итоговые списки
+    void countPair(size_t i)
+    {
+        offsets[i + 1]++;
+    }
+
+    // Степени строк превращаются в начала строк: после заполнения offsets[i + 1] станет концом строки i
+    void startFill()
+    {
+        uint64_t start = 0;
+        for (size_t i = 0; i < size(); i++)
+        {
+            uint64_t degree = offsets[i + 1];
+            offsets[i + 1] = start;
+            start += degree;
+        }
+        targets.resize(start);
+    }
+
+    void addPair(size_t i, size_t j)
+    {
+        targets[offsets[i + 1]++] = static_cast<Element>(j);
+    }
+
+    void finishFill()
+    {
+        uint64_t write = 0;
+        uint64_t rowStart = 0;
+        for (size_t i = 0; i < size(); i++)
+        {
+            uint64_t rowEnd = offsets[i + 1];
+            std::sort(targets.begin() + rowStart, targets.begin() + rowEnd);
+            uint64_t rowWrite = write;
+            for (uint64_t k = rowStart; k < rowEnd; k++)
+            {
+                if (write == rowWrite || targets[write - 1] != targets[k]) targets[write++] = targets[k];
+            }
+            offsets[i + 1] = write;
+            rowStart = rowEnd;
+        }
+        targets.resize(write);
+        targets.shrink_to_fit();
+    }
+
+    // Транспонированное отношение: пары (i, j) раскладываются по строкам j в порядке возрастания i,
+    // поэтому строки результата сразу отсортированы
+    SparseRelation transpose() const
+    {
+        SparseRelation result(size());
+        for (Element j : targets) result.countPair(j);
+        result.startFill();
+        for (size_t i = 0; i < size(); i++)
+        {
+            for (const Element* j = begin(i); j != end(i); j++) result.addPair(*j, i);
+        }
+        return result;
+    }
+
+    // Отношение с добавленными парами (i, i) для всех i
+    SparseRelation withDiagonal() const
+    {
+        SparseRelation result(size());
+        for (size_t i = 0; i < size(); i++) result.offsets[i + 1] = offsets[i + 1] - offsets[i] + 1;
+        result.startFill();
+        for (size_t i = 0; i < size(); i++)
+        {
+            for (const Element* j = begin(i); j != end(i); j++) result.addPair(i, *j);
+            result.addPair(i, i);
+        }
+        result.finishFill();
+        return result;
+    }
+
+    static SparseRelation fromBitMatrix(const BitMatrix& matrix)
+    {
+        SparseRelation result(matrix.size());
+        for (size_t i = 0; i < matrix.size(); i++)
+        {
+            const uint64_t* row = matrix.row(i);
+            for (size_t w = 0; w < matrix.usedWords(); w++) result.offsets[i + 1] += bitCount(row[w]);
+        }
+        result.startFill();
+        for (size_t i = 0; i < matrix.size(); i++)
+        {
+            const uint64_t* row = matrix.row(i);
+            for (size_t w = 0; w < matrix.usedWords(); w++)
+            {
+                for (uint64_t bits = row[w]; bits != 0; bits &= bits - 1)
+                {
+                    result.addPair(i, w * BitMatrix::WordBits + lowestBit(bits));
+                }
+            }
+        }
+        return result;
+    }
+
+    BitMatrix toBitMatrix() const
+    {
+        BitMatrix result(size());
+        for (size_t i = 0; i < size(); i++)
+        {
+            for (const Element* j = begin(i); j != end(i); j++) result.set(i, *j, true);
+        }
+        return result;
+    }
+};
@@ -4,21 +4,120 @@
 #include <string>
 #include <random>
 #include <iomanip>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include "BitMatrix.h"
+#include "MatrixReader.h"
+#include "SparseRelation.h"
+
+// Вид замыкания для RelationMatrix::close: рефлексивное (R и диагональ),
+// транзитивное (R+) и рефлексивно-транзитивное (R*)
+enum class Closure
+{
+    Reflexive,
+    Transitive,
+    ReflexiveTransitive
+};
 
-// Класс для работы с матрицей бинарного отношения и анализа её свойств
+// Класс для работы с матрицей бинарного отношения и анализа её свойств.
+// Матрица хранится по биту на элемент (BitMatrix.h), поэтому свойства проверяются
+// сразу по 64 элемента: симметрия и связанные с ней свойства сравнивают блоки 64 x 64
+// матрицы с транспонированными симметричными блоками.
+// Разреженные отношения хранятся списками соседей (SparseRelation.h), у каждой проверки
+// есть вариант для них; способ хранения выбирается по плотности после загрузки (chooseRepresentation)
 class RelationMatrix
 {
 private:
-    std::vector<std::vector<int>> matrix; // Двумерный вектор для хранения матрицы
-    int size; // Размер матрицы (по умолчанию 6x6)
+    // Метод четырёх русских для транзитивности: столбцов в группе и наименьший размер матрицы
+    static const size_t FourRussiansBits = 8;
+    static const size_t FourRussiansMinSize = 1024;
+
+    BitMatrix matrix; // Битовая матрица отношения
+    SparseRelation sparse; // Списки соседей (используются вместо matrix, если sparseForm)
+    bool sparseForm;
+    size_t size; // Размер матрицы (по умолчанию 6x6, при чтении из файла - по первой строке файла)
+
+    // Наибольший размер матрицы, которая выводится на экран целиком
+    static const size_t PrintLimit = 64;
+
+    // Наименьшее число строк на поток при параллельном замыкании
+    static const size_t MinRowsPerThread = 256;
+
+    // Обход пар блоков 64 x 64 на главной диагонали и над ней: check(direct, transposed, bi, bj),
+    // где direct - слова bj строк блока bi, а transposed - те же строки транспонированной матрицы.
+    // Проверяемые условия симметричны по (i, j), поэтому блоков под диагональю обходить не нужно
+    template <typename Check>
+    bool allBlockPairs(Check check) const
+    {
+        size_t blocks = matrix.usedWords();
+        uint64_t direct[BitMatrix::WordBits];
+        uint64_t transposed[BitMatrix::WordBits];
+        for (size_t bi = 0; bi < blocks; bi++)
+        {
+            for (size_t bj = bi; bj < blocks; bj++)
+            {
+                matrix.loadBlock(bi, bj, direct);
+                matrix.loadBlock(bj, bi, transposed);
+                BitMatrix::transpose(transposed);
+                if (!check(direct, transposed, bi, bj)) return false;
+            }
+        }
+        return true;
+    }
+
+    // Обход строк для списков соседей: check(i, row, rowEnd, column, columnEnd), где [row, rowEnd) -
+    // отсортированный список j с iRj, а [column, columnEnd) - список k с kRi (строка i транспонированного
+    // отношения). Сравнение строк R и отсортированной транспонированной R заменяет обход блоков allBlockPairs
+    template <typename Check>
+    bool allRowsWithTransposed(Check check) const
+    {
+        SparseRelation transposed = sparse.transpose();
+        for (size_t i = 0; i < size; i++)
+        {
+            if (!check(i, sparse.begin(i), sparse.end(i), transposed.begin(i), transposed.end(i))) return false;
+        }
+        return true;
+    }
+
+    // Число общих элементов двух отсортированных списков, не равных skip
+    static uint64_t commonCount(const SparseRelation::Element* a, const SparseRelation::Element* aEnd,
+        const SparseRelation::Element* b, const SparseRelation::Element* bEnd, size_t skip)
+    {
+        uint64_t common = 0;
+        while (a != aEnd && b != bEnd)
+        {
+            if (*a < *b) a++;
+            else if (*b < *a) b++;
+            else
+            {
+                if (*a != skip) common++;
+                a++;
+                b++;
+            }
+        }
+        return common;
+    }
+
+    // Элемент (i, j) при любом способе хранения
+    bool element(size_t i, size_t j) const
+    {
+        return sparseForm ? sparse.contains(i, j) : matrix.get(i, j);
+    }
+
+    // Бит диагонали в строке r блока (bi, bj)
+    static uint64_t diagonalBit(size_t bi, size_t bj, size_t r)
+    {
+        return bi == bj ? 1ull << r : 0;
+    }
 
     // Проверка рефлексивности: все элементы главной диагонали должны быть равны 1
     bool isReflexive()
     {
-        for (int i = 0; i < size; i++)
+        for (size_t i = 0; i < size; i++)
         {
             // Если найден элемент на диагонали не равный 1 - отношение не рефлексивно
-            if (matrix[i][i] != 1) return false;
+            if (!element(i, i)) return false;
         }
         return true;
     }
@@ -26,98 +125,188 @@ private:
     // Проверка антирефлексивности: все элементы главной диагонали должны быть равны 0
     bool isIrreflexive()
     {
-        for (int i = 0; i < size; i++)
+        for (size_t i = 0; i < size; i++)
         {
             // Если найден элемент на диагонали не равный 0 - отношение не антирефлексивно
-            if (matrix[i][i] != 0) return false;
+            if (element(i, i)) return false;
         }
         return true;
     }
 
-    // Проверка симметричности: матрица должна быть симметрична относительно главной диагонали
+    // Проверка симметричности: матрица должна совпадать с транспонированной
     bool isSymmetric()
     {
-        for (int i = 0; i < size; i++)
+        if (sparseForm) return sparse.transpose() == sparse;
+        return allBlockPairs([](const uint64_t* direct, const uint64_t* transposed, size_t, size_t)
         {
-            for (int j = 0; j < size; j++)
+            for (size_t r = 0; r < BitMatrix::WordBits; r++)
             {
-                // Если элемент [i][j] не равен симметричному элементу [j][i] - отношение не симметрично
-                if (matrix[i][j] != matrix[j][i]) return false;
+                if (direct[r] != transposed[r]) return false;
             }
-        }
-        return true;
+            return true;
+        });
     }
 
-    // Проверка асимметричности: если aRb, то не должно быть bRa (и диагональ должна быть нулевой)
+    // Проверка асимметричности: если aRb, то не должно быть bRa (и диагональ должна быть нулевой),
+    // то есть R и транспонированная R не пересекаются
     bool isAsymmetric()
     {
-        for (int i = 0; i < size; i++)
+        if (sparseForm)
         {
-            for (int j = 0; j < size; j++)
+            return allRowsWithTransposed([this](size_t, const SparseRelation::Element* row, const SparseRelation::Element* rowEnd,
+                const SparseRelation::Element* column, const SparseRelation::Element* columnEnd)
             {
-                // Если существует связь в обе стороны - отношение не асимметрично
-                if (matrix[i][j] == 1 && matrix[j][i] == 1)
-                {
-                    return false;
-                }
-            }
+                return commonCount(row, rowEnd, column, columnEnd, size) == 0;
+            });
         }
-        return true;
+        return allBlockPairs([](const uint64_t* direct, const uint64_t* transposed, size_t, size_t)
+        {
+            for (size_t r = 0; r < BitMatrix::WordBits; r++)
+            {
+                if (direct[r] & transposed[r]) return false;
+            }
+            return true;
+        });
     }
 
-    // Проверка антисимметричности: если aRb и bRa, то a = b
+    // Проверка антисимметричности: если aRb и bRa, то a = b,
+    // то есть пересечение R и транспонированной R лежит на диагонали
     bool isAntisymmetric()
     {
-        for (int i = 0; i < size; i++)
+        if (sparseForm)
         {
-            for (int j = 0; j < size; j++)
+            return allRowsWithTransposed([](size_t i, const SparseRelation::Element* row, const SparseRelation::Element* rowEnd,
+                const SparseRelation::Element* column, const SparseRelation::Element* columnEnd)
             {
-                // Если для i ≠ j существуют обе связи (i,j) и (j,i) - отношение не антисимметрично
-                if (i != j && matrix[i][j] == 1 && matrix[j][i] == 1)
-                {
-                    return false;
-                }
-            }
+                return commonCount(row, rowEnd, column, columnEnd, i) == 0;
+            });
         }
-        return true;
+        return allBlockPairs([](const uint64_t* direct, const uint64_t* transposed, size_t bi, size_t bj)
+        {
+            for (size_t r = 0; r < BitMatrix::WordBits; r++)
+            {
+                if (direct[r] & transposed[r] & ~diagonalBit(bi, bj, r)) return false;
+            }
+            return true;
+        });
     }
 
-    // Проверка транзитивности: если aRb и bRc, то должно выполняться aRc
+    // Проверка транзитивности: если aRb и bRc, то должно выполняться aRc.
+    // Способ выбирается по оценке числа обработанных слов: проверка строк стоит порядка
+    // (число единиц) * n / 64, метод четырёх русских - (n / 8) * (256 + n) * n / 64,
+    // поэтому он выгоден для плотных отношений большого размера
     bool isTransitive()
     {
-        for (int i = 0; i < size; i++)
+        if (sparseForm) return isTransitiveSparse();
+        uint64_t ones = matrix.count();
+        uint64_t groups = (static_cast<uint64_t>(size) + FourRussiansBits - 1) / FourRussiansBits;
+        if (size >= FourRussiansMinSize && ones > groups * ((1u << FourRussiansBits) + static_cast<uint64_t>(size)))
+        {
+            return isTransitiveFourRussians();
+        }
+        return isTransitiveByRows();
+    }
+
+    // Транзитивность по строкам: R транзитивно, если для каждой единицы (i, j)
+    // строка j - подмножество строки i (все k с jRk уже есть в строке i). O(n^3 / 64) в худшем случае
+    bool isTransitiveByRows() const
+    {
+        for (size_t i = 0; i < matrix.size(); i++)
         {
-            for (int j = 0; j < size; j++)
+            const uint64_t* row = matrix.row(i);
+            for (size_t w = 0; w < matrix.usedWords(); w++)
             {
-                for (int k = 0; k < size; k++)
+                for (uint64_t bits = row[w]; bits != 0; bits &= bits - 1)
                 {
+                    size_t j = w * BitMatrix::WordBits + lowestBit(bits);
                     // Если есть связи (i,j) и (j,k), но нет связи (i,k) - отношение не транзитивно
-                    if (matrix[i][j] == 1 && matrix[j][k] == 1 && matrix[i][k] != 1)
-                    {
-                        return false;
-                    }
+                    if (j != i && !matrix.rowSubset(j, i)) return false;
                 }
             }
         }
         return true;
     }
 
-    // Проверка связности: для любых двух различных элементов a и b выполняется aRb или bRa
-    bool isConnected()
+    // Транзитивность по спискам соседей: для каждой пары (i, j) список j вложен в список i.
+    // Слияние отсортированных списков - O(сумма по парам (i, j) степеней i и j)
+    bool isTransitiveSparse() const
     {
-        for (int i = 0; i < size; i++)
+        for (size_t i = 0; i < size; i++)
         {
-            for (int j = 0; j < size; j++)
+            for (const SparseRelation::Element* j = sparse.begin(i); j != sparse.end(i); j++)
             {
-                if (i != j && matrix[i][j] == 0 && matrix[j][i] == 0)
-                {
-                    return false;
-                }
+                if (*j != i && !sparse.rowSubset(*j, i)) return false;
+            }
+        }
+        return true;
+    }
+
+    // Метод четырёх русских: R транзитивно, если R * R (булево произведение) лежит в R.
+    // Столбцы R делятся на группы по FourRussiansBits; для группы строится таблица объединений
+    // строк группы по всем 2^FourRussiansBits сочетаниям, и вклад группы в строку i произведения -
+    // одна строка таблицы, выбранная битами строки i в этой группе. Объединение вкладов лежит
+    // в строке i тогда и только тогда, когда в ней лежит каждый вклад, поэтому группы проверяются
+    // по очереди и в памяти находится одна таблица
+    bool isTransitiveFourRussians() const
+    {
+        const size_t entries = size_t(1) << FourRussiansBits;
+        const size_t words = matrix.usedWords();
+        std::vector<uint64_t> table(entries * words);
+        for (size_t first = 0; first < matrix.size(); first += FourRussiansBits)
+        {
+            // Строка таблицы mask - объединение строк first + b для битов b маски
+            size_t width = std::min(size_t(FourRussiansBits), matrix.size() - first);
+            for (size_t mask = 1; mask < (size_t(1) << width); mask++)
+            {
+                const uint64_t* rest = &table[(mask & (mask - 1)) * words];
+                const uint64_t* added = matrix.row(first + lowestBit(mask));
+                uint64_t* target = &table[mask * words];
+                for (size_t w = 0; w < words; w++) target[w] = rest[w] | added[w];
+            }
+
+            size_t word = first / BitMatrix::WordBits, shift = first % BitMatrix::WordBits;
+            for (size_t i = 0; i < matrix.size(); i++)
+            {
+                const uint64_t* row = matrix.row(i);
+                size_t mask = (row[word] >> shift) & ((size_t(1) << width) - 1);
+                if (mask == 0) continue;
+                const uint64_t* reached = &table[mask * words];
+                uint64_t extra = 0;
+                for (size_t w = 0; w < words; w++) extra |= reached[w] & ~row[w];
+                if (extra != 0) return false;
             }
         }
         return true;
     }
 
+    // Проверка связности: для любых двух различных элементов a и b выполняется aRb или bRa,
+    // то есть R, транспонированная R и диагональ вместе покрывают всю матрицу
+    bool isConnected()
+    {
+        if (sparseForm)
+        {
+            // Каждой из n (n - 1) / 2 пар различных элементов нужна хотя бы одна пара отношения
+            uint64_t n = size;
+            if (sparse.pairCount() < n * (n - 1) / 2) return false;
+            // В строке i объединение R и транспонированной R без i должно содержать все n - 1 элементов
+            return allRowsWithTransposed([n](size_t i, const SparseRelation::Element* row, const SparseRelation::Element* rowEnd,
+                const SparseRelation::Element* column, const SparseRelation::Element* columnEnd)
+            {
+                uint64_t withoutI = (rowEnd - row) + (columnEnd - column) - 2 * (std::binary_search(row, rowEnd, i) ? 1 : 0);
+                return withoutI - commonCount(row, rowEnd, column, columnEnd, i) == n - 1;
+            });
+        }
+        return allBlockPairs([this](const uint64_t* direct, const uint64_t* transposed, size_t bi, size_t bj)
+        {
+            uint64_t columns = matrix.columnMask(bj);
+            for (size_t r = 0; r < BitMatrix::WordBits && bi * BitMatrix::WordBits + r < matrix.size(); r++)
+            {
+                if ((direct[r] | transposed[r] | diagonalBit(bi, bj, r)) != columns) return false;
+            }
+            return true;
+        });
+    }
+
     // Проверка эквивалентности: отношение должно быть рефлексивным, симметричным и транзитивным
     bool isEquivalence()
     {
@@ -149,34 +338,239 @@ private:
     }
 
     // Нахождение порядка отношения (количество элементов в множестве)
-    int findOrder()
+    size_t findOrder()
     {
         return size;
     }
 
+    // Выполнение work(first, last) для частей диапазона строк [0, n) в threads потоках
+    template <typename Work>
+    static void parallelRows(size_t n, unsigned threads, Work work)
+    {
+        size_t parts = std::max<size_t>(1, std::min<size_t>(threads, n / MinRowsPerThread));
+        if (parts == 1)
+        {
+            work(0, n);
+            return;
+        }
+        std::vector<std::thread> pool;
+        size_t chunk = (n + parts - 1) / parts;
+        for (size_t first = 0; first < n; first += chunk)
+        {
+            pool.emplace_back(work, first, std::min(n, first + chunk));
+        }
+        for (std::thread& thread : pool) thread.join();
+    }
+
+    // Транзитивное замыкание битовой матрицы алгоритмом Уоршелла: для каждой вершины k
+    // строки i с iRk объединяются со строкой k. Вершины обрабатываются блоками по 64:
+    // сначала строки блока замыкаются по вершинам блока (последовательно), после чего строка k
+    // блока содержит строки всех k' блока из неё, и каждой остальной строке i достаточно
+    // объединиться со строками k для исходных единиц слова блока. Строки блока во втором шаге
+    // только читаются, поэтому остальные строки обрабатываются параллельно в threads потоках
+    void warshallClosure(unsigned threads)
+    {
+        const size_t words = matrix.usedWords();
+        for (size_t block = 0; block < words; block++)
+        {
+            size_t first = block * BitMatrix::WordBits;
+            size_t last = std::min(size, first + BitMatrix::WordBits);
+
+            for (size_t k = first; k < last; k++)
+            {
+                const uint64_t* pivot = matrix.row(k);
+                for (size_t i = first; i < last; i++)
+                {
+                    uint64_t* row = matrix.row(i);
+                    if (i == k || !matrix.get(i, k)) continue;
+                    for (size_t w = 0; w < words; w++) row[w] |= pivot[w];
+                }
+            }
+
+            parallelRows(size, threads, [this, words, block, first, last](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    if (i >= first && i < last) continue;
+                    uint64_t* row = matrix.row(i);
+                    for (uint64_t bits = row[block]; bits != 0; bits &= bits - 1)
+                    {
+                        const uint64_t* pivot = matrix.row(first + lowestBit(bits));
+                        for (size_t w = 0; w < words; w++) row[w] |= pivot[w];
+                    }
+                }
+            });
+        }
+    }
+
+    // Транзитивное замыкание списков соседей через компоненты сильной связности (алгоритм Тарьяна
+    // без рекурсии, чтобы длинные цепочки не переполняли стек). Тарьян выдаёт компоненты в обратном
+    // топологическом порядке, поэтому к завершению компоненты c строки всех достижимых из неё
+    // компонент уже посчитаны: строка c - объединение строк компонент-преемников и их вершин,
+    // а для компоненты с циклом ещё и её собственных вершин. Строка считается один раз
+    // для представителя компоненты и копируется остальным её вершинам
+    BitMatrix closureByComponents() const
+    {
+        typedef SparseRelation::Element Element;
+        const Element None = UINT32_MAX;
+        BitMatrix result(size);
+        const size_t words = result.usedWords();
+
+        std::vector<Element> order(size, None);         // Номер вершины в порядке обхода
+        std::vector<Element> low(size);                 // Наименьший номер, достижимый из поддерева
+        std::vector<Element> component(size, None);     // Компонента (её представитель) для вершины
+        std::vector<Element> lastSeen(size, None);      // Компонента, для которой уже учтена компонента-преемник
+        std::vector<Element> path;                      // Стек вершин незавершённых компонент
+        std::vector<std::pair<Element, const Element*>> calls; // Стек обхода: вершина и следующий сосед
+        Element counter = 0;
+
+        for (size_t start = 0; start < size; start++)
+        {
+            if (order[start] != None) continue;
+            calls.push_back({ static_cast<Element>(start), sparse.begin(start) });
+            order[start] = low[start] = counter++;
+            path.push_back(static_cast<Element>(start));
+
+            while (!calls.empty())
+            {
+                Element v = calls.back().first;
+                const Element*& next = calls.back().second;
+                if (next != sparse.end(v))
+                {
+                    Element u = *next++;
+                    if (order[u] == None)
+                    {
+                        order[u] = low[u] = counter++;
+                        path.push_back(u);
+                        calls.push_back({ u, sparse.begin(u) });
+                    }
+                    else if (component[u] == None)
+                    {
+                        low[v] = std::min(low[v], order[u]);
+                    }
+                    continue;
+                }
+
+                calls.pop_back();
+                if (!calls.empty())
+                {
+                    Element parent = calls.back().first;
+                    low[parent] = std::min(low[parent], low[v]);
+                }
+                if (low[v] != order[v]) continue;
+
+                // v - корень компоненты: её вершины - верх стека path до v включительно
+                size_t top = path.size();
+                do
+                {
+                    component[path[--top]] = v;
+                } while (path[top] != v);
+
+                uint64_t* row = result.row(v);
+                bool cycle = path.size() - top > 1 || sparse.contains(v, v);
+                for (size_t m = top; m < path.size(); m++)
+                {
+                    if (cycle) row[path[m] / BitMatrix::WordBits] |= 1ull << (path[m] % BitMatrix::WordBits);
+                    for (const Element* u = sparse.begin(path[m]); u != sparse.end(path[m]); u++)
+                    {
+                        Element target = component[*u];
+                        if (target == v || lastSeen[target] == v) continue;
+                        lastSeen[target] = v;
+                        row[*u / BitMatrix::WordBits] |= 1ull << (*u % BitMatrix::WordBits);
+                        const uint64_t* reached = result.row(target);
+                        for (size_t w = 0; w < words; w++) row[w] |= reached[w];
+                    }
+                }
+                for (size_t m = top; m < path.size(); m++)
+                {
+                    if (path[m] != v) std::copy(row, row + words, result.row(path[m]));
+                }
+                path.resize(top);
+            }
+        }
+        return result;
+    }
+
+    // Добавление пар (i, i) для всех i
+    void addDiagonal()
+    {
+        if (sparseForm)
+        {
+            sparse = sparse.withDiagonal();
+            return;
+        }
+        for (size_t i = 0; i < size; i++) matrix.set(i, i, true);
+    }
+
 public:
     // Конструктор класса: инициализирует матрицу заданного размера нулями
-    RelationMatrix(int n = 6) : size(n)
+    RelationMatrix(size_t n = 6) : matrix(n), sparseForm(false), size(n)
+    {
+    }
+
+    // Новая нулевая матрица размера n x n
+    void resize(size_t n)
+    {
+        sparse = SparseRelation();
+        sparseForm = false;
+        matrix = BitMatrix(n);
+        size = n;
+    }
+
+    // Выбор способа хранения по плотности: списки соседей (8 байт на элемент и 4 байта на пару),
+    // если они меньше строк битовой матрицы (n * n / 8 байт), то есть примерно при плотности ниже 1/32
+    void chooseRepresentation()
+    {
+        uint64_t pairs = sparseForm ? sparse.pairCount() : matrix.count();
+        uint64_t matrixBytes = static_cast<uint64_t>(size) * ((size + BitMatrix::WordBits - 1) / BitMatrix::WordBits) * sizeof(uint64_t);
+        bool useSparse = SparseRelation::memoryBytes(size, pairs) < matrixBytes;
+        if (useSparse == sparseForm) return;
+        if (useSparse)
+        {
+            sparse = SparseRelation::fromBitMatrix(matrix);
+            matrix = BitMatrix();
+        }
+        else
+        {
+            matrix = sparse.toBitMatrix();
+            sparse = SparseRelation();
+        }
+        sparseForm = useSparse;
+    }
+
+    // Способ хранения для вывода
+    std::string representation() const
+    {
+        return sparseForm ? "списки соседей, " + std::to_string(sparse.memoryBytes()) + " байт"
+            : "битовая матрица, " + std::to_string(matrix.memoryBytes()) + " байт";
+    }
+
+    size_t getSize() const
     {
-        matrix.resize(size, std::vector<int>(size, 0));
+        return size;
     }
 
     // Ввод матрицы вручную с клавиатуры
     void inputManual()
     {
+        // Ручной ввод идёт в битовую матрицу
+        if (sparseForm) resize(size);
         std::cout << "Введите матрицу " << size << "x" << size << " (0 или 1, разделитель - пробел):\n";
-        for (int i = 0; i < size; i++)
+        for (size_t i = 0; i < size; i++)
         {
             std::cout << "Строка " << i + 1 << ": ";
-            for (int j = 0; j < size; j++)
+            for (size_t j = 0; j < size; j++)
             {
-                std::cin >> matrix[i][j];
+                int value;
+                std::cin >> value;
                 // Проверка на корректность ввода: допускаются только 0 и 1
-                if (matrix[i][j] != 0 && matrix[i][j] != 1)
+                if (value != 0 && value != 1)
                 {
                     std::cout << "Ошибка: вводите только 0 или 1!\n";
                     j--; // Повторяем ввод для этого элемента
+                    continue;
                 }
+                matrix.set(i, j, value == 1);
             }
         }
     }
@@ -186,15 +580,15 @@ public:
     {
         // Инициализация генератора случайных чисел
         std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, 1);
+        std::mt19937_64 gen(rd());
 
-        // Заполнение матрицы случайными значениями 0 или 1
-        for (int i = 0; i < size; i++)
+        // Заполнение матрицы случайными словами: каждый бит равен 0 или 1 с вероятностью 1/2
+        for (size_t i = 0; i < size; i++)
         {
-            for (int j = 0; j < size; j++)
+            uint64_t* row = matrix.row(i);
+            for (size_t w = 0; w < matrix.usedWords(); w++)
             {
-                matrix[i][j] = dis(gen);
+                row[w] = gen() & matrix.columnMask(w);
             }
         }
         std::cout << "Случайная матрица сгенерирована.\n";
@@ -203,7 +597,7 @@ public:
     // Чтение матрицы из файла
     bool readFromFile(const std::string& filename)
     {
-        std::ifstream file(filename);
+        std::ifstream file(filename, std::ios::binary);
         // Проверка успешности открытия файла
         if (!file.is_open())
         {
@@ -211,37 +605,100 @@ public:
             return false;
         }
 
-        // Чтение данных из файла
-        for (int i = 0; i < size; i++)
+        // Размер матрицы определяется по первой строке файла; при ошибке текущая матрица не меняется
+        std::string error;
+        BitMatrix loaded;
+        if (!MatrixReader(file).read(loaded, error))
+        {
+            std::cout << "Ошибка: " << error << ".\n";
+            return false;
+        }
+        resize(0);
+        matrix = std::move(loaded);
+        size = matrix.size();
+        chooseRepresentation();
+        std::cout << "Матрица " << size << "x" << size << " успешно загружена из файла " << filename
+            << " (" << representation() << ")" << std::endl;
+        return true;
+    }
+
+    // Чтение отношения из файла списком пар: число элементов n, затем пары номеров "a b" (от 1 до n)
+    bool readPairsFromFile(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cout << "Ошибка: не удалось открыть файл " << filename << std::endl;
+            return false;
+        }
+
+        std::string error;
+        SparseRelation loaded;
+        if (!MatrixReader(file).readPairs(loaded, error))
+        {
+            std::cout << "Ошибка: " << error << ".\n";
+            return false;
+        }
+        resize(0);
+        sparse = std::move(loaded);
+        sparseForm = true;
+        size = sparse.size();
+        chooseRepresentation();
+        std::cout << "Отношение на " << size << " элементах успешно загружено из файла " << filename
+            << " (" << representation() << ")" << std::endl;
+        return true;
+    }
+
+    // Замена отношения его замыканием. Транзитивное замыкание битовой матрицы считается
+    // параллельным алгоритмом Уоршелла, списков соседей - через компоненты сильной связности;
+    // результат транзитивного замыкания хранится битовой матрицей (n * n / 8 байт), после чего
+    // способ хранения выбирается заново. При нехватке памяти отношение не меняется
+    bool close(Closure kind)
+    {
+        try
         {
-            for (int j = 0; j < size; j++)
+            if (kind != Closure::Reflexive)
             {
-                // Проверка корректности чтения данных
-                if (!(file >> matrix[i][j]))
+                if (sparseForm)
                 {
-                    std::cout << "Ошибка: файл содержит некорректные данные или недостаточно данных.\n";
-                    return false;
+                    BitMatrix closed = closureByComponents();
+                    sparse = SparseRelation();
+                    sparseForm = false;
+                    matrix = std::move(closed);
                 }
-                // Проверка допустимых значений (только 0 и 1)
-                if (matrix[i][j] != 0 && matrix[i][j] != 1) {
-                    std::cout << "Ошибка: файл содержит значения, отличные от 0 и 1.\n";
-                    return false;
+                else
+                {
+                    warshallClosure(std::max(1u, std::thread::hardware_concurrency()));
                 }
             }
+            if (kind != Closure::Transitive) addDiagonal();
+            chooseRepresentation();
+        }
+        catch (const std::bad_alloc&)
+        {
+            std::cout << "Ошибка: недостаточно памяти для замыкания отношения на " << size << " элементах.\n";
+            return false;
         }
-        std::cout << "Матрица успешно загружена из файла " << filename << std::endl;
+        std::cout << "Замыкание построено (" << representation() << ").\n";
         return true;
     }
 
-    // Вывод матрицы на экран
+    // Вывод матрицы на экран (большие матрицы - только размер и число пар отношения)
     void printMatrix()
     {
+        if (size > PrintLimit)
+        {
+            std::cout << "\nМатрица отношения " << size << "x" << size << ": "
+                << (sparseForm ? sparse.pairCount() : matrix.count()) << " пар в отношении"
+                << " (матрицы больше " << PrintLimit << "x" << PrintLimit << " не выводятся)\n";
+            return;
+        }
         std::cout << "\nМатрица отношения " << size << "x" << size << ":\n";
-        for (int i = 0; i < size; i++)
+        for (size_t i = 0; i < size; i++)
         {
-            for (int j = 0; j < size; j++)
+            for (size_t j = 0; j < size; j++)
             {
-                std::cout << matrix[i][j] << " ";
+                std::cout << element(i, j) << " ";
             }
             std::cout << std::endl;
         }
@@ -265,7 +722,7 @@ public:
         bool strictOrder = isStrictOrder();
         bool linearOrder = isLinearOrder();
         bool strictLinearOrder = isStrictLinearOrder();
-        int order = findOrder();
+        size_t order = findOrder();
 
         // Вывод результатов проверки свойств
         std::cout << "Рефлексивность: " << (reflexive ? "ДА" : "НЕТ") << std::endl;
@@ -334,7 +791,7 @@ int main()
     int choice; // Переменная для выбора пользователя
 
     std::cout << "*** АНАЛИЗАТОР СВОЙСТВ ОТНОШЕНИЙ ***\n";
-    std::cout << "Матрица: 6x6, элементы: 0 и 1\n\n";
+    std::cout << "Матрица: 6x6 (размер матрицы из файла определяется по его первой строке), элементы: 0 и 1\n\n";
 
     // Главный цикл меню
     do {
@@ -344,6 +801,8 @@ int main()
         std::cout << "3. Чтение матрицы из файла\n";
         std::cout << "4. Вывод текущей матрицы\n";
         std::cout << "5. Анализ свойств матрицы\n";
+        std::cout << "6. Чтение отношения из файла списком пар\n";
+        std::cout << "7. Замыкание отношения\n";
         std::cout << "0. Выход\n";
         std::cout << "Выберите действие: ";
         std::cin >> choice;
@@ -356,10 +815,22 @@ int main()
             relation.inputManual();
             break;
         case 2:
-            // Генерация и вывод случайной матрицы
+        {
+            // Генерация и вывод случайной матрицы заданного размера
+            size_t n;
+            std::cout << "Введите размер матрицы (текущий - " << relation.getSize() << "): ";
+            if (!(std::cin >> n) || n == 0)
+            {
+                std::cout << "Ошибка: размер должен быть положительным числом.\n";
+                std::cin.clear();
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                break;
+            }
+            relation.resize(n);
             relation.generateRandom();
             relation.printMatrix();
             break;
+        }
         case 3:
         {
             // Чтение матрицы из файла
@@ -381,6 +852,36 @@ int main()
             relation.printMatrix();
             relation.analyzeProperties();
             break;
+        case 6:
+        {
+            // Чтение разреженного отношения: число элементов, затем пары "a b"
+            std::string filename;
+            std::cout << "Введите имя файла: ";
+            std::cin >> filename;
+            if (relation.readPairsFromFile(filename))
+            {
+                relation.printMatrix();
+            }
+            break;
+        }
+        case 7:
+        {
+            // Замена текущего отношения выбранным замыканием
+            int kind;
+            std::cout << "Вид замыкания (1 - рефлексивное, 2 - транзитивное, 3 - рефлексивно-транзитивное): ";
+            std::cin >> kind;
+            if (kind < 1 || kind > 3)
+            {
+                std::cout << "Неверный вид замыкания.\n";
+                break;
+            }
+            const Closure kinds[] = { Closure::Reflexive, Closure::Transitive, Closure::ReflexiveTransitive };
+            if (relation.close(kinds[kind - 1]))
+            {
+                relation.printMatrix();
+            }
+            break;
+        }
         case 0:
             // Выход из программы
             std::cout << "Выход из программы.\n";